@@ -0,0 +1,97 @@
+/*
+  contention.c measures the small-object tier under contention. Each of N threads repeatedly allocates ROUND_OBJECTS
+  objects of OBJECT_SIZE bytes and then frees them all, which is more than a thread cache holds, so every round spills
+  batches into the transfer caches and refills from them. The total number of malloc and free calls per second is
+  printed for each thread count given on the command line.
+
+  Given "locked" as its first argument, the program makes the same calls through mallocx and dallocx with
+  MALLOCX_TCACHE_NONE instead, which skip the thread and transfer caches and take the arena lock on every call. This
+  is the mutex-protected baseline. It is not searchList: since slabs were added, searchList no longer serves objects of
+  OBJECT_SIZE bytes, and the slab path under the arena lock is the mutex path they take without the caches.
+
+  Build and run against the shared library built from final.c and memory.c:
+    gcc -O2 -pthread -o contention contention.c -ldl
+    LD_PRELOAD=./memory.so ./contention 1 4 16 64
+    LD_PRELOAD=./memory.so ./contention locked 1 4 16 64
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#define OBJECT_SIZE 64
+#define ROUND_OBJECTS 256
+#define TOTAL_ROUNDS 40000
+//As in memory.c
+#define MALLOCX_TCACHE_NONE 0x100
+
+static int rounds;
+//Set in locked mode, looked up at run time as the C library has no mallocx
+static void *(*lockedMalloc)(size_t, int);
+static void (*lockedFree)(void *, int);
+
+static void *worker(void *arg){
+  void *objects[ROUND_OBJECTS];
+  int r, i;
+  for(r = 0; r < rounds; r++){
+    for(i = 0; i < ROUND_OBJECTS; i++){
+      objects[i] = lockedMalloc != NULL ? lockedMalloc(OBJECT_SIZE, MALLOCX_TCACHE_NONE) : malloc(OBJECT_SIZE);
+      //Keep the compiler from pairing up and removing the calls
+      *((volatile char *) objects[i]) = (char) i;
+    }
+    for(i = 0; i < ROUND_OBJECTS; i++){
+      if(lockedFree != NULL){
+        lockedFree(objects[i], MALLOCX_TCACHE_NONE);
+      }
+      else{
+        free(objects[i]);
+      }
+    }
+  }
+  return arg;
+}
+
+static double seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv){
+  pthread_t *threads;
+  double start, elapsed;
+  int arg = 1, count, i;
+  if(argc > 1 && strcmp(argv[1], "locked") == 0){
+    lockedMalloc = (void *(*)(size_t, int)) dlsym(RTLD_DEFAULT, "mallocx");
+    lockedFree = (void (*)(void *, int)) dlsym(RTLD_DEFAULT, "dallocx");
+    if(lockedMalloc == NULL || lockedFree == NULL){
+      fprintf(stderr, "mallocx and dallocx are missing, run with LD_PRELOAD=./memory.so\n");
+      return 1;
+    }
+    arg++;
+  }
+  for(; arg < argc; arg++){
+    count = atoi(argv[arg]);
+    if(count <= 0){
+      fprintf(stderr, "usage: %s [locked] threads...\n", argv[0]);
+      return 1;
+    }
+    //The same total amount of work for every thread count
+    rounds = TOTAL_ROUNDS / count;
+    threads = calloc(count, sizeof(pthread_t));
+    start = seconds();
+    for(i = 0; i < count; i++){
+      pthread_create(&threads[i], NULL, worker, NULL);
+    }
+    for(i = 0; i < count; i++){
+      pthread_join(threads[i], NULL);
+    }
+    elapsed = seconds() - start;
+    printf("%d threads: %.1f Mops/s\n", count, 2.0 * ROUND_OBJECTS * rounds * count / elapsed / 1e6);
+    free(threads);
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+  handoff.c measures the arena lock on its own, as a pthread mutex or, built with -DQUEUE_LOCK, as an MCS queue lock.
+  THREADS threads, twice the number of CPUs unless given on the command line, each take the lock ITERATIONS times,
+  hold it for a short critical section of CRITICAL_WORK steps and do OUTSIDE_WORK steps before taking it again.
+
+  Two figures are printed. The throughput is the number of times the lock was taken per second. The hand-off latency
+  is the time from a release to the moment the thread that was waiting for the lock holds it, taken over the
+  acquisitions that had to wait; its median and 99th percentile are printed.
+
+  The lock functions are static, so final.c is included rather than linked. Build both variants and run them with the
+  same thread count:
+    gcc -O2 -pthread -o handoff-mutex handoff.c
+    gcc -O2 -pthread -DQUEUE_LOCK -o handoff-queue handoff.c
+    ./handoff-mutex && ./handoff-queue
+
+  For the whole allocator under the same oversubscription, run scaling.c with twice the number of CPUs as its thread
+  count against a memory.so built with and one built without -DQUEUE_LOCK.
+*/
+#include "../final.c"
+#include <unistd.h>
+
+#define ITERATIONS 200000
+#define CRITICAL_WORK 20
+#define OUTSIDE_WORK 100
+#define MAX_SAMPLES 1000000
+
+allocLock benchLock;
+//Written by the holder of benchLock only
+volatile double releasedAt;
+volatile unsigned long shared;
+double samples[MAX_SAMPLES];
+size_t sampleCount = 0;
+
+static double seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg){
+  lockWaiter waiter;
+  volatile unsigned long local = 0;
+  double now;
+  int i, j, waited;
+  for(i = 0; i < ITERATIONS; i++){
+    waited = acquireLock(&benchLock, &waiter);
+    if(waited){
+      now = seconds();
+      if(sampleCount < MAX_SAMPLES){
+        samples[sampleCount++] = now - releasedAt;
+      }
+    }
+    for(j = 0; j < CRITICAL_WORK; j++){
+      shared++;
+    }
+    releasedAt = seconds();
+    releaseLock(&benchLock, &waiter);
+    for(j = 0; j < OUTSIDE_WORK; j++){
+      local++;
+    }
+  }
+  return arg;
+}
+
+static int compareSamples(const void *a, const void *b){
+  double x = *((const double *) a), y = *((const double *) b);
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv){
+  pthread_t ids[1024];
+  double start, elapsed;
+  int threads, t;
+  threads = argc > 1 ? atoi(argv[1]) : 2 * (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if(threads < 2 || threads > 1024){
+    printf("the thread count must be between 2 and 1024\n");
+    return 1;
+  }
+  initLock(&benchLock);
+  __threads_started_impl();
+  start = seconds();
+  for(t = 0; t < threads; t++){
+    pthread_create(&ids[t], NULL, worker, NULL);
+  }
+  for(t = 0; t < threads; t++){
+    pthread_join(ids[t], NULL);
+  }
+  elapsed = seconds() - start;
+#ifdef QUEUE_LOCK
+  printf("queue lock, %d threads\n", threads);
+#else
+  printf("pthread mutex, %d threads\n", threads);
+#endif
+  printf("  throughput: %.0f acquisitions/s\n", (double) ITERATIONS * threads / elapsed);
+  if(sampleCount == 0){
+    printf("  hand-off latency: no acquisition had to wait\n");
+    return 0;
+  }
+  qsort(samples, sampleCount, sizeof(double), compareSamples);
+  printf("  hand-off latency over %zu waits: median %.0f ns, 99th percentile %.0f ns\n", sampleCount,
+         samples[sampleCount / 2] * 1e9, samples[sampleCount * 99 / 100] * 1e9);
+  return 0;
+}
@@ -0,0 +1,53 @@
+/*
+  lockskip.c measures what taking the arena lock costs a single-threaded process. It allocates and frees one block of
+  BLOCK_SIZE bytes ITERATIONS times; blocks of that size come from the run tier, which takes the arena lock on every
+  call. The average time per malloc and free pair is printed. Passing "threads" as the argument starts and joins a
+  thread first, after which every lock is taken for real, for comparison.
+
+  One more block stays allocated throughout. Without it the arena would be empty after every free and release all of
+  its memory, and the loop would measure mapping and unmapping a run chunk rather than the lock.
+
+  Build and run against the shared library built from final.c and memory.c:
+    gcc -O2 -pthread -o lockskip lockskip.c
+    LD_PRELOAD=./memory.so ./lockskip
+    LD_PRELOAD=./memory.so ./lockskip threads
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BLOCK_SIZE 100000
+#define ITERATIONS 2000000
+
+static void *idle(void *arg){
+  return arg;
+}
+
+static double seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv){
+  pthread_t thread;
+  void *volatile block;
+  void *volatile pinned;
+  double start;
+  int i;
+  if(argc > 1 && strcmp(argv[1], "threads") == 0){
+    pthread_create(&thread, NULL, idle, NULL);
+    pthread_join(thread, NULL);
+  }
+  pinned = malloc(BLOCK_SIZE);
+  start = seconds();
+  for(i = 0; i < ITERATIONS; i++){
+    block = malloc(BLOCK_SIZE);
+    free(block);
+  }
+  printf("%.1f ns per malloc and free\n", (seconds() - start) / ITERATIONS * 1e9);
+  free(pinned);
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+  scaling.c measures how the arenas scale with the number of threads. Each thread keeps WORKING_SET blocks and
+  OPERATIONS times frees a random one of them and allocates a block of a random size between MIN_BLOCK and MAX_BLOCK
+  bytes in its place. Those sizes are served by the free list and the run tier rather than by the thread caches, so
+  every call goes to the arena of the thread and takes its lock. For each thread count the total number of malloc and
+  free calls per second is printed, along with its ratio to the rate of a single thread.
+
+  The thread counts are taken from the command line, 1 to 64 in powers of two by default. A curve only means something
+  on a machine with at least as many CPUs as the largest count; on fewer CPUs the threads take turns and the throughput
+  stays flat at best. Running the same binary without LD_PRELOAD gives the curve of the C library for comparison.
+
+  Build and run against the shared library built from final.c and memory.c:
+    gcc -O2 -pthread -o scaling scaling.c
+    LD_PRELOAD=./memory.so ./scaling
+    LD_PRELOAD=./memory.so ./scaling 1 2 3 4 6 8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define WORKING_SET 256
+#define OPERATIONS 200000
+#define MIN_BLOCK 2048
+#define MAX_BLOCK 65536
+#define MAX_THREADS 1024
+
+static const int defaultCounts[] = {1, 2, 4, 8, 16, 32, 64};
+
+static void *worker(void *arg){
+  void *blocks[WORKING_SET];
+  unsigned int seed = (unsigned int) (size_t) arg;
+  size_t size;
+  int i, slot;
+  for(i = 0; i < WORKING_SET; i++){
+    blocks[i] = malloc(MIN_BLOCK);
+  }
+  for(i = 0; i < OPERATIONS; i++){
+    slot = rand_r(&seed) % WORKING_SET;
+    size = MIN_BLOCK + rand_r(&seed) % (MAX_BLOCK - MIN_BLOCK);
+    free(blocks[slot]);
+    blocks[slot] = malloc(size);
+    //Keep the compiler from pairing up and removing the calls
+    *((volatile char *) blocks[slot]) = (char) i;
+  }
+  for(i = 0; i < WORKING_SET; i++){
+    free(blocks[i]);
+  }
+  return NULL;
+}
+
+static double seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+  measure runs threads workers at once and returns the malloc and free calls per second they made together.
+*/
+static double measure(int threads){
+  pthread_t ids[MAX_THREADS];
+  double start;
+  int t;
+  start = seconds();
+  for(t = 0; t < threads; t++){
+    pthread_create(&ids[t], NULL, worker, (void *) (size_t) (t + 1));
+  }
+  for(t = 0; t < threads; t++){
+    pthread_join(ids[t], NULL);
+  }
+  return 2.0 * OPERATIONS * threads / (seconds() - start);
+}
+
+int main(int argc, char **argv){
+  double rate, single;
+  int i, threads, counts;
+  counts = argc > 1 ? argc - 1 : (int) (sizeof(defaultCounts) / sizeof(defaultCounts[0]));
+  single = measure(1);
+  printf("%8s %16s %12s\n", "threads", "calls/s", "vs 1 thread");
+  for(i = 0; i < counts; i++){
+    threads = argc > 1 ? atoi(argv[i + 1]) : defaultCounts[i];
+    if(threads < 1 || threads > MAX_THREADS){
+      printf("thread counts must be between 1 and %d\n", MAX_THREADS);
+      return 1;
+    }
+    rate = threads == 1 ? single : measure(threads);
+    printf("%8d %16.0f %11.2fx\n", threads, rate, rate / single);
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+/*
+  scan.c measures the scan kernels that search the free table in FREE_TABLE mode. For a table of 1K, 10K and 100K free
+  blocks in which only the last block fits, it times scanUnitsScalar, scanUnitsAVX2 and scanUnitsAVX512 finding that
+  block and prints the lookups per second of each. Kernels the CPU does not support are skipped.
+
+  The kernels are static, so final.c is included rather than linked, built in FREE_TABLE mode. On x86-64 with gcc this
+  also compiles the vector kernels. Build and run:
+    gcc -O2 -DFREE_TABLE -pthread -o scan scan.c
+    ./scan
+*/
+#include "../final.c"
+
+#define MIN_SECONDS 0.5
+
+static const size_t tableSizes[] = {1000, 10000, 100000};
+
+static double seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+  lookupRate returns the lookups per second of kernel on the count units, running it for at least MIN_SECONDS.
+*/
+static double lookupRate(size_t (*kernel)(const unsigned int *, size_t, unsigned int), const unsigned int *units,
+                         size_t count, unsigned int need){
+  volatile size_t found;
+  double start, elapsed;
+  size_t lookups = 0, i;
+  start = seconds();
+  do{
+    for(i = 0; i < 64; i++){
+      found = kernel(units, count, need);
+    }
+    lookups += 64;
+    elapsed = seconds() - start;
+  }while(elapsed < MIN_SECONDS);
+  if(found != count - 1){
+    printf("kernel found entry %zu instead of %zu\n", (size_t) found, count - 1);
+    exit(1);
+  }
+  return lookups / elapsed;
+}
+
+int main(){
+  unsigned int *units;
+  size_t count, i, t;
+  unsigned int need = 64;
+  __builtin_cpu_init();
+  printf("%-12s %14s %14s %14s\n", "free blocks", "scalar", "AVX2", "AVX-512");
+  for(t = 0; t < sizeof(tableSizes) / sizeof(tableSizes[0]); t++){
+    count = tableSizes[t];
+    units = malloc(count * sizeof(unsigned int));
+    for(i = 0; i < count; i++){
+      units[i] = need - 1;
+    }
+    units[count - 1] = need;
+    printf("%-12zu %14.0f", count, lookupRate(scanUnitsScalar, units, count, need));
+#ifdef FREE_TABLE_SIMD
+    if(__builtin_cpu_supports("avx2")){
+      printf(" %14.0f", lookupRate(scanUnitsAVX2, units, count, need));
+    }
+    else{
+      printf(" %14s", "-");
+    }
+    if(__builtin_cpu_supports("avx512f")){
+      printf(" %14.0f", lookupRate(scanUnitsAVX512, units, count, need));
+    }
+    else{
+      printf(" %14s", "-");
+    }
+#else
+    printf(" %14s %14s", "-", "-");
+#endif
+    printf("\n");
+    free(units);
+  }
+  return 0;
+}
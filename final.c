@@ -38,14 +38,28 @@
     
 */
 
+#define _GNU_SOURCE
 #include <stddef.h>
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#ifdef QUEUE_LOCK
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#if defined(FREE_TABLE) && defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define FREE_TABLE_SIMD
+#endif
 //Each mmap will be of a minimum of 16MB to reduce the number of mmap calls neccesary
 #define MIN_SIZE (size_t) 16777216
+#define PAGE_SIZE (size_t) 4096
 /* Predefined helper functions */
 
 static void *__memset(void *s, int c, size_t n) {
@@ -133,34 +147,724 @@ static int __try_size_t_multiply(size_t *c, size_t a, size_t b) {
    list probably needs to be kept ordered by ascending addresses.
 */
 
-/*typedef node defines nodes to hold the address, the size in bytes of the memory node, and pointers to the next and previous
- nodes*/
+/*typedef node defines nodes to hold the arena the block belongs to, the size in bytes of the memory node, and pointers to
+ the next and previous nodes*/
 typedef struct node{
-  void *addr;
+  struct arena *arena;
   size_t size;
   struct node *next;
   struct node *prev;
 }node;
 
-//Define Head and counters for number of malloc calls and number of free calls
-node *head = NULL;
-int NUM_ALLOCATIONS = 0;
-int NUM_FREED = 0;
+/*
+  The locks of the arenas are allocLocks. By default an allocLock is a pthread mutex. Compiled with -DQUEUE_LOCK, it is an
+  MCS queue lock instead: threads waiting for the lock line up in a queue of lockWaiters, which live on their stacks,
+  and the lock is handed to the waiters strictly in turn. Each waiter only watches its own lockWaiter, spinning for
+  LOCK_SPINS rounds and then parking on it with a futex until its predecessor hands the lock over. Short waits thus
+  never go through the kernel, and a release wakes exactly the next thread rather than every sleeper.
+  Callers pass a lockWaiter of their own to acquireLock and releaseLock.
+
+  As long as the process has a single thread there is nobody to exclude, and acquireLock does not touch the lock at all;
+  it only notes in the lockWaiter that releaseLock has nothing to undo. memory.c wraps pthread_create and calls
+  __threads_started_impl before the second thread of the process exists. From then on every lock is taken for real,
+  and a lock that was skipped before is released, as a no-op, by the very thread that skipped it. The reclaimer does not
+  end this on its own: while the process has a single thread, wakeReclaimer releases memory in the calling thread
+  instead of starting it, unless MEMORY_BACKGROUND asks for it.
+
+  Threads that glibc starts by itself, such as those of timer_create with SIGEV_THREAD or of the aio functions, do not
+  go through the wrapper. Such a thread calls __threads_started_impl when it is first bound to an arena, see
+  currentArena, but a lock that the first thread skipped just before is not excluded against it. A program whose only
+  other threads are of that kind should start one thread of its own first.
+*/
+int multiThreaded = 0;
+
+/*
+  __threads_started_impl switches the allocator from single-threaded to locked operation. It is called by the
+  pthread_create wrapper in memory.c, before the new thread is started.
+*/
+void __threads_started_impl(void){
+  __atomic_store_n(&multiThreaded, 1, __ATOMIC_SEQ_CST);
+}
+
+#ifdef QUEUE_LOCK
+#define LOCK_SPINS 256
+#if defined(__x86_64__) || defined(__i386__)
+#define cpuRelax() __builtin_ia32_pause()
+#else
+#define cpuRelax()
+#endif
+//States of a lockWaiter: the lock has been handed over, the waiter is spinning, the waiter is parked
+#define WAITER_OWNER 0
+#define WAITER_SPINNING 1
+#define WAITER_PARKED 2
+
+typedef struct lockWaiter{
+  struct lockWaiter *next;
+  int state;
+  int held;
+}lockWaiter;
+
+typedef struct allocLock{
+  lockWaiter *tail;
+}allocLock;
+
+/*
+  initLock sets up a free lock.
+*/
+static void initLock(allocLock *lock){
+  lock->tail = NULL;
+}
+
+/*
+  acquireLock takes lock, queueing up behind the current holder and waiters if there are any. Returns 1 if the lock was
+  held by another thread and had to be waited for, 0 otherwise.
+*/
+static int acquireLock(allocLock *lock, lockWaiter *me){
+  lockWaiter *previous;
+  int spins;
+  me->held = __atomic_load_n(&multiThreaded, __ATOMIC_RELAXED);
+  if(!me->held){
+    return 0;
+  }
+  me->next = NULL;
+  me->state = WAITER_SPINNING;
+  previous = __atomic_exchange_n(&lock->tail, me, __ATOMIC_ACQ_REL);
+  if(previous == NULL){
+    return 0;
+  }
+  __atomic_store_n(&previous->next, me, __ATOMIC_RELEASE);
+  for(spins = 0; spins < LOCK_SPINS; spins++){
+    if(__atomic_load_n(&me->state, __ATOMIC_ACQUIRE) == WAITER_OWNER){
+      return 1;
+    }
+    cpuRelax();
+  }
+  //Park, unless the lock was handed over in the meantime
+  spins = WAITER_SPINNING;
+  if(__atomic_compare_exchange_n(&me->state, &spins, WAITER_PARKED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+    while(__atomic_load_n(&me->state, __ATOMIC_ACQUIRE) != WAITER_OWNER){
+      syscall(SYS_futex, &me->state, FUTEX_WAIT_PRIVATE, WAITER_PARKED, NULL, NULL, 0);
+    }
+  }
+  return 1;
+}
+
+/*
+  tryAcquireLock takes lock only if it is free and nobody is queued for it. Returns 1 if the lock was taken, 0 otherwise.
+*/
+static int tryAcquireLock(allocLock *lock, lockWaiter *me){
+  lockWaiter *expected = NULL;
+  me->held = __atomic_load_n(&multiThreaded, __ATOMIC_RELAXED);
+  if(!me->held){
+    return 1;
+  }
+  me->next = NULL;
+  me->state = WAITER_OWNER;
+  return __atomic_compare_exchange_n(&lock->tail, &expected, me, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/*
+  releaseLock hands lock to the next waiter in the queue, waking it if it is parked, or frees it if there is none.
+*/
+static void releaseLock(allocLock *lock, lockWaiter *me){
+  lockWaiter *next, *expected;
+  if(!me->held){
+    return;
+  }
+  next = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE);
+  if(next == NULL){
+    expected = me;
+    if(__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+      return;
+    }
+    //A waiter has swapped itself in as the tail and is about to link itself behind us
+    while((next = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE)) == NULL){
+      cpuRelax();
+    }
+  }
+  if(__atomic_exchange_n(&next->state, WAITER_OWNER, __ATOMIC_ACQ_REL) == WAITER_PARKED){
+    syscall(SYS_futex, &next->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+#else
+typedef struct lockWaiter{
+  int held;
+}lockWaiter;
+
+typedef pthread_mutex_t allocLock;
+
+static void initLock(allocLock *lock){
+  pthread_mutex_init(lock, NULL);
+}
+
+static int acquireLock(allocLock *lock, lockWaiter *me){
+  me->held = __atomic_load_n(&multiThreaded, __ATOMIC_RELAXED);
+  if(!me->held){
+    return 0;
+  }
+  if(pthread_mutex_trylock(lock) == 0){
+    return 0;
+  }
+  pthread_mutex_lock(lock);
+  return 1;
+}
+
+static int tryAcquireLock(allocLock *lock, lockWaiter *me){
+  me->held = __atomic_load_n(&multiThreaded, __ATOMIC_RELAXED);
+  if(!me->held){
+    return 1;
+  }
+  return pthread_mutex_trylock(lock) == 0;
+}
+
+static void releaseLock(allocLock *lock, lockWaiter *me){
+  if(me->held){
+    pthread_mutex_unlock(lock);
+  }
+}
+#endif
+
+/*
+  All allocator state lives in arenas. Each arena has its own free list (or free table), wilderness, run chunks and slabs,
+  and its own lock, so threads working in different arenas never wait for each other. Every thread is bound to an arena
+  and allocates from it; a block is always freed back into the arena it came from, which is recorded in its node header
+  or, for small and medium blocks, in the header of its run chunk. See currentArena for how threads are spread over the
+  arenas.
+*/
+#define SIZE_CLASSES 24
+#define SLAB_BUCKETS 4
+
+typedef struct arena{
+  allocLock lock;
+  //Number of threads currently bound to the arena
+  int threads;
+  //Define Head and counters for number of malloc calls and number of free calls
+  node *head;
+  size_t numAllocations;
+  size_t numFreed;
+  struct freeEntry *freeTable;
+  size_t freeCount;
+  size_t freeCapacity;
+  unsigned int *freeUnits;
+  void *topStart;
+  void *topEnd;
+  struct runChunk *runChunks;
+  struct slab *slabBuckets[SIZE_CLASSES][SLAB_BUCKETS];
+  struct slab *spareSlabs[SIZE_CLASSES];
+  size_t seenOperations;
+  int privateHeap;
+  struct releaseRecord *mappings;
+  //Set for the arenas of lifetime hints, which no thread is bound to, see lifetimeArena
+  int lifetime;
+}arena;
+
+/*
+  Memory is never unmapped while an arena is locked. Ranges that are no longer needed are put on releaseQueue by
+  queueRelease, which only costs a compare and swap, and are unmapped in batches by a background reclaimer thread, so
+  other threads do not stall on the munmap system call and the TLB shootdowns it causes. The queue is linked through
+  releaseRecords written at the start of the ranges themselves. The reclaimer is started on the first release, outside
+  of any arena lock; should it fail to start, the queue is drained by the releasing thread instead. The reclaimer also
+  carries out the frees deferred with __free_deferred_impl, see drainDeferred.
+
+  If the environment variable MEMORY_BACKGROUND is set to yes, the reclaimer also takes over the housekeeping of the
+  arenas: it is started along with the first arena and wakes up every MAINTENANCE_INTERVAL_MS milliseconds to run
+  maintainArenas, and malloc and free leave coalescing, trimming and releasing memory to it, see backgroundMaintenance.
+  The arena locks, like the locks of the reclaimer, are all taken around fork, so that the child does not inherit one
+  that a thread it does not have was holding. The fork handlers are installed along with the first arena.
+*/
+typedef struct releaseRecord{
+  struct releaseRecord *next;
+  size_t size;
+}releaseRecord;
+
+#define RECLAIMER_IDLE 0
+#define RECLAIMER_RUNNING 1
+#define RECLAIMER_FAILED 2
+releaseRecord *releaseQueue = NULL;
+//Number of threads reading the lock-free transfer caches, see takeBatch
+int stackReaders = 0;
+int reclaimerState = RECLAIMER_IDLE;
+void *deferredQueue = NULL;
+#define MAINTENANCE_INTERVAL_MS 100
+int backgroundMaintenance = 0;
+pthread_mutex_t reclaimLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reclaimCond = PTHREAD_COND_INITIALIZER;
+
+/*
+  queueRelease hands the range [addr, addr + size), a whole number of pages, to the reclaimer.
+*/
+static void queueRelease(void *addr, size_t size){
+  releaseRecord *record = (releaseRecord *) addr;
+  record->size = size;
+  record->next = __atomic_load_n(&releaseQueue, __ATOMIC_RELAXED);
+  while(!__atomic_compare_exchange_n(&releaseQueue, &record->next, record, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+  }
+}
+
+/*
+  releaseQueued takes the whole release queue at once and unmaps every range on it.
+*/
+static void releaseQueued(){
+  releaseRecord *record, *next;
+  record = __atomic_exchange_n(&releaseQueue, NULL, __ATOMIC_ACQUIRE);
+  //A thread in takeBatch may still read the memory of a batch that has been freed meanwhile
+  while(__atomic_load_n(&stackReaders, __ATOMIC_SEQ_CST) != 0){
+    sched_yield();
+  }
+  while(record != NULL){
+    next = record->next;
+    munmap(record, record->size);
+    record = next;
+  }
+}
+
+static void drainDeferred();
+static void maintainArenas();
+static void prepareFork();
+static void parentAfterFork();
+static void childAfterFork();
+static void retireTagCounters();
+static void lockCaches();
+static void unlockCaches();
+static void resetCaches();
+
+/*
+  maintenanceDue returns 1 and moves *due MAINTENANCE_INTERVAL_MS milliseconds past the current time if *due has passed,
+  0 otherwise.
+*/
+static int maintenanceDue(struct timespec *due){
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  if(now.tv_sec < due->tv_sec || (now.tv_sec == due->tv_sec && now.tv_nsec < due->tv_nsec)){
+    return 0;
+  }
+  due->tv_sec = now.tv_sec;
+  due->tv_nsec = now.tv_nsec + MAINTENANCE_INTERVAL_MS * 1000000L;
+  if(due->tv_nsec >= 1000000000L){
+    due->tv_sec++;
+    due->tv_nsec -= 1000000000L;
+  }
+  return 1;
+}
+
+/*
+  reclaimerMain is the body of the reclaimer thread: it sleeps until ranges or deferred frees are queued, carries out
+  the frees and then releases the ranges, including those the frees made redundant. With backgroundMaintenance, it
+  sleeps no longer than until the next round of maintenance is due.
+*/
+static void *reclaimerMain(void *unused){
+  struct timespec due = {0, 0};
+  int timedOut;
+  (void) unused;
+  while(1){
+    timedOut = 0;
+    pthread_mutex_lock(&reclaimLock);
+    while(__atomic_load_n(&releaseQueue, __ATOMIC_ACQUIRE) == NULL && __atomic_load_n(&deferredQueue, __ATOMIC_ACQUIRE) == NULL && !timedOut){
+      if(backgroundMaintenance){
+        timedOut = pthread_cond_timedwait(&reclaimCond, &reclaimLock, &due) == ETIMEDOUT;
+      }
+      else{
+        pthread_cond_wait(&reclaimCond, &reclaimLock);
+      }
+    }
+    pthread_mutex_unlock(&reclaimLock);
+    drainDeferred();
+    if(backgroundMaintenance && maintenanceDue(&due)){
+      maintainArenas();
+    }
+    releaseQueued();
+  }
+  return NULL;
+}
+
+/*
+  wakeReclaimer gets queued ranges released and deferred frees done, starting the reclaimer thread if it is not running
+  yet, which with backgroundMaintenance it is started even if nothing is queued. While the process has a single thread
+  and backgroundMaintenance is off, the calling thread does the work instead. It must not be called with an arena
+  locked, as starting a thread allocates memory.
+*/
+static void wakeReclaimer(){
+  pthread_t thread;
+  int state;
+  if(__atomic_load_n(&releaseQueue, __ATOMIC_ACQUIRE) == NULL && __atomic_load_n(&deferredQueue, __ATOMIC_ACQUIRE) == NULL &&
+     !(backgroundMaintenance && __atomic_load_n(&reclaimerState, __ATOMIC_ACQUIRE) == RECLAIMER_IDLE)){
+    return;
+  }
+  //Starting a thread ends lock skipping, so a single-threaded process does the work itself
+  if(!__atomic_load_n(&multiThreaded, __ATOMIC_RELAXED) && !backgroundMaintenance){
+    drainDeferred();
+    releaseQueued();
+    return;
+  }
+  state = RECLAIMER_IDLE;
+  if(__atomic_compare_exchange_n(&reclaimerState, &state, RECLAIMER_RUNNING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+    if(pthread_create(&thread, NULL, reclaimerMain, NULL) == 0){
+      pthread_detach(thread);
+      state = RECLAIMER_RUNNING;
+    }
+    else{
+      state = RECLAIMER_FAILED;
+      __atomic_store_n(&reclaimerState, state, __ATOMIC_RELEASE);
+    }
+  }
+  if(state == RECLAIMER_FAILED){
+    drainDeferred();
+    releaseQueued();
+    return;
+  }
+  pthread_mutex_lock(&reclaimLock);
+  pthread_cond_signal(&reclaimCond);
+  pthread_mutex_unlock(&reclaimLock);
+}
 
 void* __malloc_impl(size_t size);
 
+#ifdef FREE_TABLE
+/*
+  With FREE_TABLE defined, the free list does not live inside the free blocks. Instead every free block is described by
+  a freeEntry (address and size) in freeTable, a dense array kept sorted by ascending addresses and allocated from its own
+  mapping. Searching the free blocks then scans contiguous memory instead of chasing next pointers across the 16MB
+  mappings, and free memory is never written to, so it does not have to be faulted in or kept resident. Only the header
+  of an allocated block is ever touched.
+*/
+typedef struct freeEntry{
+  void *addr;
+  size_t size;
+}freeEntry;
+
+//The table holds FREE_TABLE_MIN_ENTRIES entries to start with and doubles whenever it runs full
+#define FREE_TABLE_MIN_ENTRIES (size_t) 4096
+
+/*
+  freeUnits mirrors the sizes of freeTable as packed 32 bit counts of sizeof(node) units, so that a vector register holds
+  8 (AVX2) or 16 (AVX-512) of them. Sizes that do not fit are saturated at UNITS_MAX, which still compares as "at least"
+  any smaller request; such candidates are confirmed against the real size in freeTable. The array shares the mapping
+  of freeTable and directly follows its freeCapacity entries.
+*/
+#define UNITS_MAX 0xffffffffu
+
+/*
+  sizeToUnits converts a size in bytes to a count of sizeof(node) units, saturating at UNITS_MAX.
+*/
+static unsigned int sizeToUnits(size_t size){
+  size /= sizeof(node);
+  if(size > (size_t) UNITS_MAX){
+    return UNITS_MAX;
+  }
+  return (unsigned int) size;
+}
+
+/*
+  scanUnitsScalar returns the index of the first of the count units that is at least need, or count if there is none.
+*/
+static size_t scanUnitsScalar(const unsigned int *units, size_t count, unsigned int need){
+  size_t i;
+  for(i = 0; i < count; i++){
+    if(units[i] >= need){
+      return i;
+    }
+  }
+  return count;
+}
+
+#ifdef FREE_TABLE_SIMD
+/*
+  scanUnitsAVX2 does the same as scanUnitsScalar, comparing 8 units per instruction. AVX2 has no unsigned comparison, so
+  units[i] >= need is tested as max(units[i], need) == units[i].
+*/
+__attribute__((target("avx2")))
+static size_t scanUnitsAVX2(const unsigned int *units, size_t count, unsigned int need){
+  size_t i;
+  __m256i needs, v;
+  int mask;
+  needs = _mm256_set1_epi32((int) need);
+  for(i = 0; i + 8 <= count; i += 8){
+    v = _mm256_loadu_si256((const __m256i *) (units + i));
+    mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_max_epu32(v, needs), v)));
+    if(mask != 0){
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + scanUnitsScalar(units + i, count - i, need);
+}
+
+/*
+  scanUnitsAVX512 does the same as scanUnitsScalar, comparing 16 units per instruction.
+*/
+__attribute__((target("avx512f")))
+static size_t scanUnitsAVX512(const unsigned int *units, size_t count, unsigned int need){
+  size_t i;
+  __m512i needs;
+  __mmask16 mask;
+  needs = _mm512_set1_epi32((int) need);
+  for(i = 0; i + 16 <= count; i += 16){
+    mask = _mm512_cmpge_epu32_mask(_mm512_loadu_si512((const void *) (units + i)), needs);
+    if(mask != 0){
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + scanUnitsScalar(units + i, count - i, need);
+}
+#endif
+
+/*
+  scanUnits points to the widest scan kernel the CPU supports. It starts out at selectScanUnits, which makes the choice on
+  the first search and replaces itself.
+*/
+static size_t selectScanUnits(const unsigned int *units, size_t count, unsigned int need);
+static size_t (*scanUnits)(const unsigned int *, size_t, unsigned int) = selectScanUnits;
+
+static size_t selectScanUnits(const unsigned int *units, size_t count, unsigned int need){
+  scanUnits = scanUnitsScalar;
+#ifdef FREE_TABLE_SIMD
+  //Malloc may run before the constructors of libgcc, so make sure the CPU model is known
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f")){
+    scanUnits = scanUnitsAVX512;
+  }
+  else if(__builtin_cpu_supports("avx2")){
+    scanUnits = scanUnitsAVX2;
+  }
+#endif
+  return scanUnits(units, count, need);
+}
+
+/*
+  tableSetSize sets the size of entry i, keeping freeUnits in step with freeTable.
+*/
+static void tableSetSize(arena *a, size_t i, size_t size){
+  a->freeTable[i].size = size;
+  a->freeUnits[i] = sizeToUnits(size);
+}
+
+/*
+  resizeTable moves freeTable to a mapping of newCapacity entries, which must be at least freeCount. A new mapping is
+  created with mmap, the entries are copied over and the old mapping is released. Returns 0 on success and -1 if the
+  mappings could not be created.
+*/
+static int resizeTable(arena *a, size_t newCapacity){
+  size_t newSize;
+  freeEntry *newTable;
+  //Each entry takes a freeEntry in freeTable and a unit count in freeUnits
+  if(!__try_size_t_multiply(&newSize, newCapacity, sizeof(freeEntry) + sizeof(unsigned int))){
+    return -1;
+  }
+  newTable = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(newTable == MAP_FAILED){
+    return -1;
+  }
+  if(a->freeTable != NULL){
+    __memcpy(newTable, a->freeTable, a->freeCount * sizeof(freeEntry));
+    __memcpy(newTable + newCapacity, a->freeUnits, a->freeCount * sizeof(unsigned int));
+    queueRelease(a->freeTable, a->freeCapacity * (sizeof(freeEntry) + sizeof(unsigned int)));
+  }
+  a->freeTable = newTable;
+  a->freeUnits = (unsigned int *) (newTable + newCapacity);
+  a->freeCapacity = newCapacity;
+  return 0;
+}
+
+/*
+  growTable doubles the capacity of freeTable. Returns 0 on success and -1 if the mappings could not be created.
+*/
+static int growTable(arena *a){
+  if(a->freeCapacity == 0){
+    return resizeTable(a, FREE_TABLE_MIN_ENTRIES);
+  }
+  return resizeTable(a, a->freeCapacity * 2);
+}
+
+/*
+  shrinkTable halves the capacity of freeTable if less than a quarter of it is in use, down to FREE_TABLE_MIN_ENTRIES.
+*/
+static void shrinkTable(arena *a){
+  if(a->freeCapacity > FREE_TABLE_MIN_ENTRIES && a->freeCount < a->freeCapacity / 4){
+    resizeTable(a, a->freeCapacity / 2);
+  }
+}
+
+/*
+  tableIndex returns the index of the first entry of freeTable whose address is not lower than addr, using binary search.
+  If all entries are below addr, freeCount is returned.
+*/
+static size_t tableIndex(arena *a, void *addr){
+  size_t low = 0, high = a->freeCount, mid;
+  while(low < high){
+    mid = low + (high - low) / 2;
+    if(a->freeTable[mid].addr < addr){
+      low = mid + 1;
+    }
+    else{
+      high = mid;
+    }
+  }
+  return low;
+}
+
+/*
+  tableRemove removes the entry at index i, shifting the following entries down by one.
+*/
+static void tableRemove(arena *a, size_t i){
+  size_t j;
+  for(j = i; j + 1 < a->freeCount; j++){
+    a->freeTable[j] = a->freeTable[j + 1];
+    a->freeUnits[j] = a->freeUnits[j + 1];
+  }
+  a->freeCount--;
+}
+
+/*
+  tableInsert records the free range [addr, addr + size) in freeTable. If the range touches the free range before or after
+  it, the entries are merged instead of a new entry being added, so the table is always fully coalesced. Returns 0 on
+  success and -1 if the table could not be grown.
+*/
+static int tableInsert(arena *a, void *addr, size_t size){
+  size_t i, j;
+  i = tableIndex(a, addr);
+  //Merge with the previous entry if it ends where the new range starts
+  if(i > 0 && a->freeTable[i - 1].addr + a->freeTable[i - 1].size == addr){
+    tableSetSize(a, i - 1, a->freeTable[i - 1].size + size);
+    //The grown entry may now also reach the next entry
+    if(i < a->freeCount && a->freeTable[i - 1].addr + a->freeTable[i - 1].size == a->freeTable[i].addr){
+      tableSetSize(a, i - 1, a->freeTable[i - 1].size + a->freeTable[i].size);
+      tableRemove(a, i);
+    }
+    return 0;
+  }
+  //Merge with the next entry if the new range ends where it starts
+  if(i < a->freeCount && addr + size == a->freeTable[i].addr){
+    a->freeTable[i].addr = addr;
+    tableSetSize(a, i, a->freeTable[i].size + size);
+    return 0;
+  }
+  if(a->freeCount == a->freeCapacity && growTable(a) < 0){
+    return -1;
+  }
+  //Shift the following entries up by one to make room at index i
+  for(j = a->freeCount; j > i; j--){
+    a->freeTable[j] = a->freeTable[j - 1];
+    a->freeUnits[j] = a->freeUnits[j - 1];
+  }
+  a->freeTable[i].addr = addr;
+  tableSetSize(a, i, size);
+  a->freeCount++;
+  return 0;
+}
+
+/*
+  In table mode a block leaves the free structures as soon as searchList hands it out, so there is nothing left to unlink.
+*/
+void removeNode(arena *a, node* node){
+  (void) a;
+  (void) node;
+}
+
+/*
+  The table is coalesced on every insertion, there is nothing left to merge.
+*/
+void mergeBlocks(arena *a){
+  (void) a;
+}
+
+/*
+  A block the table cannot be grown for is kept on head, which table mode does not use otherwise, linked through its
+  header, until there is room for it, so that it is never lost. tableSpilled moves the blocks on head into the table.
+  Returns 0 once head is empty and -1 if the table still cannot take them.
+*/
+static int tableSpilled(arena *a){
+  node *spilled;
+  while(a->head != NULL){
+    spilled = a->head;
+    if(tableInsert(a, spilled, spilled->size) < 0){
+      return -1;
+    }
+    a->head = spilled->next;
+  }
+  return 0;
+}
+
+/*
+  insertNode records the block starting at node, of node->size bytes, as free, after any blocks that did not fit before.
+  Only the header is touched.
+*/
+void insertNode(arena *a, node *node){
+  if(tableSpilled(a) < 0 || tableInsert(a, node, node->size) < 0){
+    node->next = a->head;
+    a->head = node;
+  }
+}
+
+/*
+  insertNodes records the count blocks in nodes, sorted by ascending address, as free. Each insertion coalesces with its
+  neighbours, so sorting only keeps the moves within the table short.
+*/
+void insertNodes(arena *a, node **nodes, size_t count){
+  size_t i;
+  for(i = 0; i < count; i++){
+    insertNode(a, nodes[i]);
+  }
+}
+
+/*
+  searchList scans freeUnits with the scanUnits kernel for the first entry of at least size bytes. The block is carved out
+  of the low end of the entry, so the entry only needs its address and size updated; an exactly fitting entry is removed.
+  The size of the carved block is written to its header, which is the only write to the block. Returns NULL if no entry is
+  large enough.
+*/
+node* searchList(arena *a, size_t size){
+  size_t i;
+  node *block;
+  unsigned int need;
+  //size is a multiple of sizeof(node), so comparing units is exact unless the units saturated
+  need = sizeToUnits(size);
+  for(i = scanUnits(a->freeUnits, a->freeCount, need); i < a->freeCount; i += 1 + scanUnits(a->freeUnits + i + 1, a->freeCount - i - 1, need)){
+    if(size <= a->freeTable[i].size){
+      block = (node*) a->freeTable[i].addr;
+      //Only split if the remainder is large enough to be handed out as a block itself
+      if(a->freeTable[i].size - size >= sizeof(node)){
+        a->freeTable[i].addr += size;
+        tableSetSize(a, i, a->freeTable[i].size - size);
+      }
+      else{
+        size = a->freeTable[i].size;
+        tableRemove(a, i);
+      }
+      block->size = size;
+      return block;
+    }
+  }
+  return NULL;
+}
+
+/*
+  takeBlockEndingAt removes the free block that ends exactly at end from the table. Returns its address and stores its
+  size in *size, or returns NULL if no free block ends there.
+*/
+static void *takeBlockEndingAt(arena *a, void *end, size_t *size){
+  size_t i;
+  void *addr;
+  i = tableIndex(a, end);
+  if(i == 0 || a->freeTable[i - 1].addr + a->freeTable[i - 1].size != end){
+    return NULL;
+  }
+  addr = a->freeTable[i - 1].addr;
+  *size = a->freeTable[i - 1].size;
+  tableRemove(a, i - 1);
+  return addr;
+}
+#else
 /*  removeNode takes a memory node pointer as an argument and removes it from the list of free nodes. Previous and next 
     pointers are updated */
 
-void removeNode(node* node){
+void removeNode(arena *a, node* node){
   if(node->prev == NULL){
     if(node->next){
       //If node has no previous but has a next, update pointer to head
-      head = node->next;
+      a->head = node->next;
     }
     //If node has no previous and no next, list is of length one, return NULL
     else{
-      head = NULL;
+      a->head = NULL;
     }
   }
     else{
@@ -174,9 +878,12 @@ void removeNode(node* node){
 /*   mergeBlocks iterates over the ordered list and checks if any of the blocks are consecutive, and if they are, merge 
      them into one large block */
 
-  void mergeBlocks(){
-    node* currentNode = head;
+  void mergeBlocks(arena *a){
+    node* currentNode = a->head;
     void* currentAddress, *nextAddress;
+    if(currentNode == NULL){
+      return;
+    }
     while(currentNode->next != NULL){
       currentAddress = currentNode;
       nextAddress = currentNode->next;
@@ -189,9 +896,8 @@ void removeNode(node* node){
 	if(currentNode->next != NULL){
 	  currentNode->next->prev = currentNode;
 	}
-	else{
-	  break;
-	}
+	//Stay on currentNode, the grown block may also reach the following one
+	continue;
       }
       currentNode = currentNode->next;
     }
@@ -202,28 +908,68 @@ void removeNode(node* node){
   addresses. Stored in this fashion to allow for the mergeBlocks function above 
 
 */
-void insertNode(node *node){
+void insertNode(arena *a, node *node){
+    struct node *currentNode;
     node->prev = NULL;
     node->next = NULL;
     //If empty list or if address of node is less than address of current head, set head to node
-    if((head == NULL) || head > node){
-      if(head){
-        head->prev = node;
+    if((a->head == NULL) || a->head > node){
+      if(a->head){
+        a->head->prev = node;
       }
-      struct node *newNode = head;
+      struct node *newNode = a->head;
       node->next = newNode;
-      head = node;
+      a->head = node;
       }
     else{
       //Iterate over list until either the end is hit or the address of node is greater than the current node
-      while((head->next) && head->next < head){
-       head = head->next;
+      currentNode = a->head;
+      while((currentNode->next) && currentNode->next < node){
+       currentNode = currentNode->next;
       }
       //Update pointers, node is inserted after currentNode
-      node->next = head->next;
-      node->prev = head;
-      head->next = node;
+      node->next = currentNode->next;
+      node->prev = currentNode;
+      if(currentNode->next){
+        currentNode->next->prev = node;
+      }
+      currentNode->next = node;
+    }
+}
+
+/*
+  insertNodes inserts the count nodes in nodes, sorted by ascending address, into the list in one walk: each node is
+  inserted after the one before it, so the list is only traversed once rather than once per node.
+*/
+void insertNodes(arena *a, node **nodes, size_t count){
+  struct node *currentNode = NULL;
+  size_t i;
+  for(i = 0; i < count; i++){
+    nodes[i]->prev = NULL;
+    nodes[i]->next = NULL;
+    if(currentNode == NULL && (a->head == NULL || a->head > nodes[i])){
+      nodes[i]->next = a->head;
+      if(a->head){
+        a->head->prev = nodes[i];
+      }
+      a->head = nodes[i];
+      currentNode = nodes[i];
+      continue;
+    }
+    if(currentNode == NULL){
+      currentNode = a->head;
+    }
+    while((currentNode->next) && currentNode->next < nodes[i]){
+      currentNode = currentNode->next;
+    }
+    nodes[i]->next = currentNode->next;
+    nodes[i]->prev = currentNode;
+    if(currentNode->next){
+      currentNode->next->prev = nodes[i];
     }
+    currentNode->next = nodes[i];
+    currentNode = nodes[i];
+  }
 }
 
 /*
@@ -233,35 +979,34 @@ void insertNode(node *node){
 
 */ 
 
-node* searchList(size_t size){
-     node *temp = head;
+node* searchList(arena *a, size_t size){
+     node *temp = a->head;
      node* newNode;
      //Account for case empty list
-     if(head == NULL){
+     if(a->head == NULL){
        return NULL;
      }
     //returns the first memory node with size greater than size
      while(temp != NULL){
        /*Iterate over list until we find a node of at least size that has at least sizeof(node) leftover after removing up
        until 'size'*/
-      if(size <  temp->size && (temp->size - size > sizeof(node))){
+      if(size <  temp->size && (temp->size - size >= sizeof(node))){
 	//Create a new node out of the remainder of the block, starting at size bytes
 	newNode = (node*)(((void*) temp) + size);
 	//Update the node size after slice
 	newNode->size = temp->size - size;
 	temp->size = size;
+	//Link the remainder in right after temp, the caller removes temp from the list
 	newNode->next = temp->next;
-	//If temp was the only node in the list, update head to be newNode
-	if(temp->next == NULL){
-	  head = newNode;
-	}
-	//Remove temp from list
-	else{	  
-	  newNode->prev = temp->prev;
-	  if(newNode->prev != NULL){
-	    newNode->prev->next = newNode;
-	  }
+	newNode->prev = temp;
+	if(temp->next != NULL){
+	  temp->next->prev = newNode;
 	}
+	temp->next = newNode;
+	return temp;
+      }
+      //An exactly fitting node is handed out whole
+      if(size == temp->size){
 	return temp;
       }
       temp = temp->next;
@@ -271,224 +1016,3579 @@ node* searchList(size_t size){
   }
 
 /*
-  createBlock takes a size in bytes and creates a new memory mapping using mmap. The size of the mappings is at least MIN_SIZE
-  (16MB), and if size is larger than MIN_SIZE, creates a mapping that is a mutiple of the header size (sizeof(node) ). This is
+  takeBlockEndingAt removes the free node that ends exactly at end from the list. Returns the node and stores its size in
+  *size, or returns NULL if no free node ends there.
+*/
+static void *takeBlockEndingAt(arena *a, void *end, size_t *size){
+  node *curr;
+  for(curr = a->head; curr != NULL && (void*) curr < end; curr = curr->next){
+    if(((void*) curr) + curr->size == end){
+      *size = curr->size;
+      removeNode(a, curr);
+      return curr;
+    }
+  }
+  return NULL;
+}
+#endif
+
+/*
+  The most recently mapped memory is kept out of the free list as the wilderness, the free range [topStart, topEnd) at the
+  end of the mapping. It is only carved from, at its low end, when no free block fits, so the untouched tail stays in one
+  piece and fragmentation is concentrated below it. When it runs short it is grown in place by mapping the pages right
+  after topEnd, and freed blocks that end at topStart are given back to it. Once it holds more than TOP_TRIM_SIZE bytes
+  its tail is unmapped, which makes returning memory to the kernel cheap.
+*/
+#define TOP_TRIM_SIZE (2 * MIN_SIZE)
+
+/*
+  retireTop hands whatever is left of the wilderness to the free list, before a new mapping takes its place.
+*/
+static void retireTop(arena *a){
+  node *rest;
+  if(a->topStart != a->topEnd){
+    rest = (node*) a->topStart;
+    rest->size = a->topEnd - a->topStart;
+    insertNode(a, rest);
+  }
+  a->topStart = NULL;
+  a->topEnd = NULL;
+}
+
+/*
+  createBlock takes a size in bytes and creates a new memory mapping using mmap. The size of the mappings is at least MIN_SIZE
+  (16MB), and if size is larger than MIN_SIZE, creates a mapping that is a mutiple of the header size (sizeof(node) ). This is
   to ensure that slices may be taken out of the mapping there will always be enough space for headers. The multiplication of 
   the size of node and the number of nodes required to be larger than requested size is done using the provided __try_size_t_multiply function to ensure no error mutiplying bytes. Memory mappings are made private and anonymous 
+  The mapping is rounded up to whole pages, its size is stored in *mapped. It is placed at hint if the kernel agrees,
+  which is how the wilderness is extended in place. createBlock does not touch any arena, so it is called without the
+  arena locked; publishTop then hands the mapping to the arena. Returns NULL if the mapping could not be created.
 
 */
-  void createBlock(size_t size){
+  void *createBlock(size_t size, void *hint, size_t *mapped){
     size_t sizeRequest, minSize, newSize;
     void *p;
-    node* newBlock;
     //Handle size 0 case
     newSize = (size_t) 0;
     if(size == (size_t) 0){
-      return;
+      return NULL;
     }
-    minSize = MIN_SIZE / sizeof(node);
-    sizeRequest = size + sizeof(node);
+    minSize = MIN_SIZE / PAGE_SIZE;
+    //Round up to whole pages so that the end of the mapping is where it can be extended
+    sizeRequest = size + PAGE_SIZE - 1;
     //Handle overflow
-    if(sizeRequest < 0){
-	return;
+    if(sizeRequest < size){
+	return NULL;
      }
-    //By using integer division with the sizeof(node), sizeRequest * sizeof(node) will always be a multiple of node size
-    sizeRequest /= sizeof(node);
+    sizeRequest /= PAGE_SIZE;
     //If the size is less than 16MB, set sizeRequest to 16MB
     if(sizeRequest < minSize){
       sizeRequest = minSize;
     }
     //Use provided helper function to peform multiplication
-    __try_size_t_multiply(&newSize, sizeRequest, sizeof(node));
+    __try_size_t_multiply(&newSize, sizeRequest, PAGE_SIZE);
     //Mutiplication overflowed if newSize is 0
     if(newSize == 0){
-      return;
+      return NULL;
     }
-    p = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    p = mmap(hint, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     //Catch mmap errors
     if(p == MAP_FAILED){
-      return;
+      return NULL;
     }
-    //Populate fields and insert newNode into list
-    newBlock = (node*) p;
-    newBlock->size = newSize;
-    newBlock->prev = NULL; 
-    newBlock->next = NULL;
-    insertNode(newBlock);
-    
+    *mapped = newSize;
+    return p;
+  }
+
+/*
+  publishTop gives the new mapping [p, p + size) from createBlock to arena a, for a block of need bytes. If the mapping
+  landed right after the wilderness, the wilderness simply grows. Otherwise it becomes the new wilderness if the current
+  one still cannot hold need bytes, the rest of the old one going to the free list; if another thread has refilled the
+  wilderness in the meantime, the mapping is put on the free list instead.
+*/
+static void publishTop(arena *a, void *p, size_t size, size_t need){
+  node *block;
+  if(a->topEnd != NULL && p == a->topEnd){
+    a->topEnd += size;
+    return;
+  }
+  if((size_t) (a->topEnd - a->topStart) < need){
+    retireTop(a);
+    a->topStart = p;
+    a->topEnd = p + size;
+    return;
+  }
+  block = (node*) p;
+  block->size = size;
+  insertNode(a, block);
+  mergeBlocks(a);
+}
+
+/*
+  topAlloc carves a block of size bytes off the low end of the wilderness. Returns NULL if the wilderness is too small,
+  in which case the caller has to refill it through createBlock and publishTop.
+*/
+static node *topAlloc(arena *a, size_t size){
+  node *block;
+  if((size_t) (a->topEnd - a->topStart) < size){
+    return NULL;
   }
+  block = (node*) a->topStart;
+  block->size = size;
+  a->topStart += size;
+  return block;
+}
+
+/*
+  trimTop unmaps the tail of the wilderness, keeping at least keep bytes of it.
+*/
+static void trimTop(arena *a, size_t keep){
+  void *end;
+  if(a->topStart == NULL || (size_t) (a->topEnd - a->topStart) <= keep){
+    return;
+  }
+  end = (void *) ((((size_t) a->topStart) + keep + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+  if(end < a->topEnd){
+    queueRelease(end, a->topEnd - end);
+    a->topEnd = end;
+  }
+}
+
+/*
+  absorbIntoTop gives the free block ending at topStart, if there is one, back to the wilderness, and unmaps the tail of
+  the wilderness once it has grown beyond TOP_TRIM_SIZE bytes, keeping MIN_SIZE of it. With backgroundMaintenance, the
+  trimming is left to maintainArena. The wilderness of a private heap is never trimmed, see heapDestroy.
+*/
+static void absorbIntoTop(arena *a){
+  void *start;
+  size_t size;
+  if(a->topStart == NULL){
+    return;
+  }
+  start = takeBlockEndingAt(a, a->topStart, &size);
+  if(start != NULL){
+    a->topStart = start;
+  }
+  if(!backgroundMaintenance && !a->privateHeap && (size_t) (a->topEnd - a->topStart) > TOP_TRIM_SIZE){
+    trimTop(a, MIN_SIZE);
+  }
+}
+
+/*
+  unmapTop releases the wilderness. It is called along with unmapBlocks, when every block has been freed and given back,
+  so the wilderness then starts at the beginning of its mapping.
+*/
+static void unmapTop(arena *a){
+  void *start;
+  if(a->topStart != NULL){
+    start = (void *) ((((size_t) a->topStart) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    if(start < a->topEnd){
+      queueRelease(start, a->topEnd - start);
+    }
+  }
+  a->topStart = NULL;
+  a->topEnd = NULL;
+}
   
 /*
-  unmapBlocks iterates over the list and calls munmap to release the mapped memory. 
+  unmapBlocks iterates over the list and hands the mapped memory to the reclaimer to be released with munmap. 
   NOTE* unmapBlocks is called when the number of allocated nodes is equal to the number of freed nodes. 
   This means that if the user of these functions does not free every node they allocate, unmap will not
   be called. 
 
 */
-void unmapBlocks(){
-  node *curr = head;
-  node* next = curr->next;
+#ifdef FREE_TABLE
+void unmapBlocks(arena *a){
+  size_t i;
+  //Spilled blocks may share pages with the entries, so nothing is released until they are merged with them
+  if(tableSpilled(a) < 0){
+    return;
+  }
+  for(i = 0; i < a->freeCount; i++){
+    queueRelease(a->freeTable[i].addr, a->freeTable[i].size);
+  }
+  a->freeCount = 0;
+}
+#else
+void unmapBlocks(arena *a){
+  node *curr = a->head;
+  node *next;
   while(curr != NULL){
-    if(munmap(curr, curr->size) < 0){
-      //Display any error messages and return if unmmap is unsuccessful
-      fprintf(stderr,"Error munmapping: %s\n", strerror(errno));
-      return;
-    }   
-    if(next != NULL){
-      next = next->next;
-    }
+    //Read the next pointer before the node is overwritten by its release record
+    next = curr->next;
+    queueRelease(curr, curr->size);
     curr = next;
   }
+  a->head = NULL;
 }
-/* End of your helper functions */
+#endif
+/*
+  Medium allocations, from RUN_MIN_SIZE up to RUN_MAX_SIZE bytes, do not go through the free list. They are served as
+  runs of contiguous PAGE_SIZE pages out of dedicated run chunks of MIN_SIZE bytes, which are aligned to MIN_SIZE. Each
+  chunk starts with a runChunk header holding a bitmap of the pages in use and, for the first page of every allocated
+  run, the length of that run in pages, and a pointer to the allocation tags of its blocks, see tagBlock. A run is found
+  by scanning the bitmap for enough clear bits and freeing a run clears its bits again, so it merges with the free pages
+  around it without any further work. Medium blocks are page aligned, carry no header and never split or fragment the
+  small-object heap.
+*/
+#define PAGES_PER_CHUNK (MIN_SIZE / PAGE_SIZE)
+#define RUN_MIN_SIZE PAGE_SIZE
+#define RUN_MAX_SIZE ((size_t) 1048576)
 
-/* Start of the actual malloc/calloc/realloc/free functions */
+typedef struct runChunk{
+  arena *arena;
+  struct runChunk *next;
+  struct runChunk *prev;
+  size_t freePages;
+  unsigned char *allocTags;
+  unsigned long long used[PAGES_PER_CHUNK / 64];
+  unsigned short runPages[PAGES_PER_CHUNK];
+}runChunk;
 
-void __free_impl(void *);
+//The pages at the start of the chunk that hold the runChunk header itself are permanently in use
+#define HEADER_PAGES ((sizeof(runChunk) + PAGE_SIZE - 1) / PAGE_SIZE)
+//The allocation tags of a chunk take a byte for every ALLOC_TAG_GRANULE bytes, the smallest block size
+#define ALLOC_TAG_GRANULE ((size_t) 16)
+#define ALLOC_TAG_MAP_SIZE (MIN_SIZE / ALLOC_TAG_GRANULE)
 
 /*
-  __malloc_impl is an implementation of the malloc system call and functions in the same fashion. It accepts 
-  a size in bytes and returns a pointer to a free memory block of the requested size. This is accomplished by 
-  searching the list of free memory nodes for a node of sufficent size. If no node of sufficent size is found, 
-  one of greater size is created using the above createBlocks function and a slice of requested size is returned. 
-  Each node contains a header populated with information about the node, namely the size and pointers to next and
-  previous nodes. __malloc_impl returns a void pointer to the free memory immediately following the header, 
-  denoted startofFreeBlock. 
+  chunkKinds records, for every MIN_SIZE aligned piece of the address space, what kind of chunk is mapped there, so that
+  __free_impl can tell a run allocation from a free list block with a single load. The array covers the 47 bit user
+  address space at one byte per chunk; it is mapped with MAP_NORESERVE, so only the pages of it that are actually written
+  become resident. It is created along with the first run chunk, before which every pointer belongs to the free list.
+*/
+#define CHUNK_LIST 0
+#define CHUNK_RUNS 1
+#define CHUNK_KINDS_ENTRIES (((size_t) 1 << 47) / MIN_SIZE)
+unsigned char *chunkKinds = NULL;
 
+/*
+  chunkKind returns the kind of chunk ptr points into.
 */
-void *__malloc_impl(size_t size) {
-  //Handle case where requested size is 0
-  size_t sizeofBlock;
-  node *ptr;
-  void* startofFreeBlock;
-  if(size == (size_t) 0){
-    return NULL;
+static int chunkKind(void *ptr){
+  size_t index = ((size_t) ptr) / MIN_SIZE;
+  unsigned char *kinds = __atomic_load_n(&chunkKinds, __ATOMIC_ACQUIRE);
+  if(kinds == NULL || index >= CHUNK_KINDS_ENTRIES){
+    return CHUNK_LIST;
   }
-  //account for the header size
-  sizeofBlock = size + sizeof(node);
-   //Return NULL is addition overflows
-  if(sizeofBlock < 0){
+  return kinds[index];
+}
+
+/*
+  mapAligned maps size bytes aligned to align, a power of two that is a multiple of PAGE_SIZE. A mapping of size + align
+  bytes is created and the parts before and after the aligned range are unmapped again. Returns NULL if mmap fails.
+*/
+static void *mapAligned(size_t size, size_t align){
+  void *p, *aligned;
+  size_t lead;
+  if(size + align < size){
     return NULL;
   }
-  ptr = searchList(sizeofBlock);
-  if(ptr != NULL){
-    //Found a block of sufficent size, account for header
-    void* startofFreeBlock = ptr + sizeof(node);
-    //ptr has been allocated and so remove from list
-    removeNode(ptr);
-    //Increment global counter NUM_ALLOCATIONS for the purpose of determining if every allocated node has been freed
-    NUM_ALLOCATIONS++;
-    return startofFreeBlock;
+  p = mmap(NULL, size + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED){
+    return NULL;
   }
-  //If no block of the right size is in the list, create a new one.
-  createBlock(sizeofBlock);
-  //Search again, a block of large enough size should exist barring errors
-  ptr = searchList(sizeofBlock); 
-  if(ptr != NULL){
-    //Repeat above steps 
-    startofFreeBlock = ptr + sizeof(node);
-    removeNode(ptr);
-    NUM_ALLOCATIONS++;  
-    return startofFreeBlock;
+  aligned = (void *) ((((size_t) p) + align - 1) & ~(align - 1));
+  lead = aligned - p;
+  if(lead > 0){
+    munmap(p, lead);
   }
-  //If any errors occured and no blocks where found, return NULL
-  return NULL;
+  munmap(aligned + size, align - lead);
+  return aligned;
 }
 
 /*
+  setPages marks the count pages starting at page first as used (value 1) or free (value 0) in the bitmap of chunk.
+*/
+static void setPages(runChunk *chunk, size_t first, size_t count, int value){
+  size_t i;
+  for(i = first; i < first + count; i++){
+    if(value){
+      chunk->used[i / 64] |= 1ULL << (i % 64);
+    }
+    else{
+      chunk->used[i / 64] &= ~(1ULL << (i % 64));
+    }
+  }
+}
 
-  __calloc_impl is an implemenation of the calloc system call. Memory is manually allocated and then set to 0. 
-  It accepts two sizes in bytes, one for the size of the members and the total size. Multiplication of these two sizes is 
-  implemented using the provided _try_size_t_multiply function. Once the total size is found, __calloc_impl calls __malloc_impl 
-  to create the block. Each member is set to '0' using the provided __memset function 
+/*
+  nextPage returns the index of the first page at or after page start whose bit equals value, or PAGES_PER_CHUNK if there
+  is none. Whole words that cannot contain such a page are skipped at once.
+*/
+static size_t nextPage(runChunk *chunk, size_t start, int value){
+  size_t i;
+  unsigned long long word;
+  i = start / 64;
+  if(i >= PAGES_PER_CHUNK / 64){
+    return PAGES_PER_CHUNK;
+  }
+  //Look for set bits, inverting the word when looking for clear ones, and ignore the bits below start
+  word = value ? chunk->used[i] : ~chunk->used[i];
+  word &= ~0ULL << (start % 64);
+  while(word == 0){
+    i++;
+    if(i >= PAGES_PER_CHUNK / 64){
+      return PAGES_PER_CHUNK;
+    }
+    word = value ? chunk->used[i] : ~chunk->used[i];
+  }
+  return i * 64 + __builtin_ctzll(word);
+}
 
+/*
+  findRun returns the index of the first page of a run of count free pages in chunk that starts at a multiple of align
+  pages, or PAGES_PER_CHUNK if there is no such run.
 */
+static size_t findRun(runChunk *chunk, size_t count, size_t align){
+  size_t start, end;
+  start = nextPage(chunk, 0, 0);
+  while(1){
+    start = (start + align - 1) / align * align;
+    if(start + count > PAGES_PER_CHUNK){
+      break;
+    }
+    end = nextPage(chunk, start, 1);
+    if(end - start >= count){
+      return start;
+    }
+    start = nextPage(chunk, end, 0);
+  }
+  return PAGES_PER_CHUNK;
+}
 
-void *__calloc_impl(size_t nmemb, size_t size) {
-  size_t sizeRequired;
-  void *ptr;
-  int multiplySuccess;
-  //Use provided mutiply function to multiply nmeb and size, returns 1 on success, 0 on failure
-  multiplySuccess = __try_size_t_multiply(&sizeRequired, nmemb, size);
-  if(multiplySuccess){
-  //Use new implementation of malloc
-    ptr = __malloc_impl(sizeRequired);
-    if(ptr != NULL){
-      //Use provided memset function to set all to 0
-      __memset(ptr, 0, sizeRequired);
+/*
+  createRunChunk maps a new MIN_SIZE aligned run chunk for arena a and registers it in chunkKinds. It is called without
+  the arena locked; the chunk is only put on the runChunks of the arena by publishRunChunk. Returns NULL if the mappings
+  could not be created.
+*/
+static runChunk *createRunChunk(arena *a){
+  runChunk *chunk;
+  void *kinds;
+  if(__atomic_load_n(&chunkKinds, __ATOMIC_ACQUIRE) == NULL){
+    kinds = mmap(NULL, CHUNK_KINDS_ENTRIES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(kinds == MAP_FAILED){
+      return NULL;
     }
-    return ptr;
+    //Several arenas may get here at once, only one of them gets to install its map
+    if(!__sync_bool_compare_and_swap(&chunkKinds, NULL, kinds)){
+      munmap(kinds, CHUNK_KINDS_ENTRIES);
+    }
+  }
+  chunk = mapAligned(MIN_SIZE, MIN_SIZE);
+  if(chunk == NULL){
+    return NULL;
+  }
+  //The mapping is fresh and hence zero, so all pages are free apart from the header pages
+  setPages(chunk, 0, HEADER_PAGES, 1);
+  chunk->freePages = PAGES_PER_CHUNK - HEADER_PAGES;
+  chunk->arena = a;
+  chunkKinds[((size_t) chunk) / MIN_SIZE] = CHUNK_RUNS;
+  return chunk;
+}
+
+/*
+  publishRunChunk puts a chunk from createRunChunk at the front of the runChunks of arena a.
+*/
+static void publishRunChunk(arena *a, runChunk *chunk){
+  chunk->prev = NULL;
+  chunk->next = a->runChunks;
+  if(a->runChunks != NULL){
+    a->runChunks->prev = chunk;
+  }
+  a->runChunks = chunk;
+}
+
+/*
+  unlinkRunChunk takes chunk off the runChunks of arena a.
+*/
+static void unlinkRunChunk(arena *a, runChunk *chunk){
+  if(chunk->prev != NULL){
+    chunk->prev->next = chunk->next;
   }
   else{
-    //Return null in case of any errors
+    a->runChunks = chunk->next;
+  }
+  if(chunk->next != NULL){
+    chunk->next->prev = chunk->prev;
+  }
+}
+
+/*
+  releaseRunChunk unlinks chunk from runChunks, clears its entry in chunkKinds and hands it to the reclaimer.
+*/
+static void releaseRunChunk(arena *a, runChunk *chunk){
+  unlinkRunChunk(a, chunk);
+  chunkKinds[((size_t) chunk) / MIN_SIZE] = CHUNK_LIST;
+  if(chunk->allocTags != NULL){
+    queueRelease(chunk->allocTags, ALLOC_TAG_MAP_SIZE);
+  }
+  queueRelease(chunk, MIN_SIZE);
+}
+
+/*
+  runAlloc returns a run of enough pages to hold size bytes, starting at a multiple of align pages, taken from the first
+  run chunk that has one. Returns NULL if no chunk has, in which case the caller has to add a chunk through
+  createRunChunk and publishRunChunk.
+*/
+static void *runAlloc(arena *a, size_t size, size_t align){
+  runChunk *chunk;
+  size_t count, first;
+  count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+  for(chunk = a->runChunks; chunk != NULL; chunk = chunk->next){
+    if(chunk->freePages >= count){
+      first = findRun(chunk, count, align);
+      if(first < PAGES_PER_CHUNK){
+        break;
+      }
+    }
+  }
+  if(chunk == NULL){
     return NULL;
   }
+  setPages(chunk, first, count, 1);
+  chunk->runPages[first] = (unsigned short) count;
+  chunk->freePages -= count;
+  return ((void *) chunk) + first * PAGE_SIZE;
 }
 
 /*
-  __realloc_impl is an implemenation of system call realloc. It takes a previously allocated node and a new size
-  and adjusts the size of the node. If the pointer is null, __realloc_impl calls __malloc_impl and returns the allocated
-  space. If size is 0, __realloc_impl calls __free_impl to free the node. If the new size is smaller than that of the 
-  existing node, only the memory up until new size is copied. Other size it copies all of the space up until the size of 
-  the existing node and leaves the remainder unpopulated. Memory copies are done using the provided __memcopy function
+  runSize returns the size in bytes of the run starting at ptr.
+*/
+static size_t runSize(void *ptr){
+  runChunk *chunk = (runChunk *) (((size_t) ptr) & ~(MIN_SIZE - 1));
+  return chunk->runPages[(ptr - (void *) chunk) / PAGE_SIZE] * PAGE_SIZE;
+}
 
+/*
+  runFree gives the run starting at ptr back to its chunk. A chunk that ends up entirely free is unmapped, unless it is the
+  only run chunk left, which is kept to avoid mapping a new one on the next medium allocation, or backgroundMaintenance
+  is on and a is not a private heap, in which case maintainArena releases it.
 */
+static void runFree(arena *a, void *ptr){
+  runChunk *chunk;
+  size_t first;
+  chunk = (runChunk *) (((size_t) ptr) & ~(MIN_SIZE - 1));
+  first = (ptr - (void *) chunk) / PAGE_SIZE;
+  setPages(chunk, first, chunk->runPages[first], 0);
+  chunk->freePages += chunk->runPages[first];
+  chunk->runPages[first] = 0;
+  if(chunk->freePages == PAGES_PER_CHUNK - HEADER_PAGES && (chunk->prev != NULL || chunk->next != NULL) && (!backgroundMaintenance || a->privateHeap)){
+    releaseRunChunk(a, chunk);
+  }
+}
 
-void *__realloc_impl(void *ptr, size_t size) {
-  void *newptr;
-  node* nodePtr;
-  size_t oldSize;
-  //If size is 0, realloc function as free, call free on ptr
-  if(size == (size_t) 0){
-   __free_impl(ptr);
+/*
+  unmapRunChunks releases all run chunks. Like unmapBlocks, it is only called once every allocation has been freed.
+*/
+static void unmapRunChunks(arena *a){
+  while(a->runChunks != NULL){
+    releaseRunChunk(a, a->runChunks);
   }
-  /*Information about the node, including the previous size, is
-    stored in the header found at ptr - sizeof(node)*/
-  nodePtr = (node*)ptr - sizeof(node);
-  oldSize = nodePtr->size;
-  newptr = __malloc_impl(size);
-  //If ptr is null, realloc functions as malloc 
-  if((ptr) == NULL){
-    return newptr;
-  }  
- 
-  /*Copy the full size of the old block if it is smaller than the size value passed,
-    otherwise use the argument.*/
-  if (oldSize < size) {
-    //Use provided __memcpy function to copy memory from old to new memory blocks
-    __memcpy(ptr, newptr, oldSize);
+}
+/*
+  Small allocations, of up to SLAB_MAX_SIZE bytes, are rounded up to one of SIZE_CLASSES size classes and served from
+  slabs. A slab is a run of SLAB_SIZE bytes, aligned to SLAB_SIZE within its run chunk, that starts with a slab header and
+  is cut into objects of one class. Objects are handed out from the slab's own free list, or carved off the untouched part
+  of the slab, so a fresh slab is only faulted in as it fills.
+
+  Partially used slabs of a class sit in SLAB_BUCKETS lists by occupancy, and allocation always takes from the fullest
+  non-empty bucket. Objects thus pile up in the slabs that are already full while nearly empty slabs get no new objects,
+  drain, and go back to the run tier as soon as they are empty; a run chunk whose slabs have all drained is unmapped.
+  One empty slab per class is kept as a spare so that a class does not map and release a slab on every other call.
+
+  Small and medium blocks are first told from free list blocks by the chunkKinds entry of their chunk. Within a run
+  chunk, a slab object is then told from a medium run by its address and the run lengths in the chunk header, see
+  isSlabObject: medium blocks start at the first page of their run, whereas the first object of a slab starts after its
+  header, so objects never sit at the start of a run. A pointer that is not page aligned is thus an object, and a page
+  aligned one is an object if no run starts at its page.
+*/
+#define SLAB_SIZE ((size_t) 16384)
+#define SLAB_MAX_SIZE ((size_t) 2048)
+//Slab headers are padded so that the first object is aligned like any other block
+#define SLAB_HEADER_SIZE ((size_t) 64)
+
+typedef struct slab{
+  struct slab *next;
+  struct slab *prev;
+  void *freeObjects;
+  size_t objectSize;
+  unsigned short sizeClass;
+  unsigned short used;
+  unsigned short carved;
+  unsigned short capacity;
+  int bucket;
+}slab;
+
+//Sizes of the classes: steps of 16 bytes up to 128, then four steps per doubling
+static const unsigned short classSizes[SIZE_CLASSES] = {
+  16, 32, 48, 64, 80, 96, 112, 128,
+  160, 192, 224, 256, 320, 384, 448, 512,
+  640, 768, 896, 1024, 1280, 1536, 1792, 2048
+};
+
+//A slab that is full is not in any bucket
+#define SLAB_FULL -1
+
+/*
+  sizeClassOf returns the index of the smallest size class that holds size bytes, size being at most SLAB_MAX_SIZE.
+*/
+static int sizeClassOf(size_t size){
+  int b;
+  if(size <= 128){
+    return size == 0 ? 0 : (int) ((size - 1) / 16);
   }
-  else {
-	__memcpy(ptr, newptr, size);
+  //size - 1 lies in [2^b, 2^(b+1)), which the four classes from 8 + 4 * (b - 7) on split into steps of 2^(b-2)
+  b = 63 - __builtin_clzll(size - 1);
+  return 8 + 4 * (b - 7) + (int) ((size - 1 - ((size_t) 1 << b)) >> (b - 2));
+}
+
+/*
+  slabOf returns the slab holding the object at ptr.
+*/
+static slab *slabOf(void *ptr){
+  return (slab *) (((size_t) ptr) & ~(SLAB_SIZE - 1));
+}
+
+/*
+  isSlabObject tells whether ptr, a pointer into a run chunk, is a slab object rather than a medium run.
+*/
+static int isSlabObject(void *ptr){
+  return (((size_t) ptr) & (PAGE_SIZE - 1)) != 0 || runSize(ptr) == 0;
+}
+
+/*
+  slabBucketOf returns the bucket a slab with s->used objects in use belongs in, or SLAB_FULL.
+*/
+static int slabBucketOf(slab *s){
+  if(s->used == s->capacity){
+    return SLAB_FULL;
   }
-  //Free old pointer and return new pointer
-  __free_impl(ptr);
-  return newptr;
+  return (s->used * SLAB_BUCKETS) / s->capacity;
 }
 
 /*
-  __free_impl is an implemenation of the system call free. It takes a void pointer to previously allocated memory 
-  and adds it to the list of free memory nodes. This is done by retrieving the information about the node in the
-  header that was populated when the node was allocated. NOTE* if free is called on a pointer that was not allocated, 
-  casting to a node* to retrieve node information will result in a segmentation fault. A check is made if the number
-  of allocations is equal to the number of freed nodes, and if so, __free_impl calls unmapBlocks to release the memory. 
+  unlinkSlab takes s out of its bucket list, if it is in one.
+*/
+static void unlinkSlab(arena *a, slab *s){
+  if(s->bucket == SLAB_FULL){
+    return;
+  }
+  if(s->prev != NULL){
+    s->prev->next = s->next;
+  }
+  else{
+    a->slabBuckets[s->sizeClass][s->bucket] = s->next;
+  }
+  if(s->next != NULL){
+    s->next->prev = s->prev;
+  }
+  s->bucket = SLAB_FULL;
+}
 
+/*
+  placeSlab moves s to the bucket matching its occupancy. Slabs enter at the front of a bucket, so the slabs that were
+  filled up most recently are the first to be filled further.
 */
- void __free_impl(void *ptr){
-   //Handle case free(nil)
-   if(ptr == NULL){
-     return;
-   }
-   //Increment global counter NUM_FREED to check if all nodes have been freed
-   NUM_FREED++;
-   //Retrieve header
-   node* freeBlock = (node*)ptr - sizeof(node);
-   insertNode(freeBlock);
-   mergeBlocks();
-   if(NUM_FREED == NUM_ALLOCATIONS){
-     //Call mergeBlocks one final time to ensure the list is an condensed as possible
-     mergeBlocks();
-     unmapBlocks();
-   }
+static void placeSlab(arena *a, slab *s){
+  int bucket = slabBucketOf(s);
+  if(bucket == s->bucket){
+    return;
+  }
+  unlinkSlab(a, s);
+  if(bucket == SLAB_FULL){
+    return;
+  }
+  s->bucket = bucket;
+  s->prev = NULL;
+  s->next = a->slabBuckets[s->sizeClass][bucket];
+  if(s->next != NULL){
+    s->next->prev = s;
+  }
+  a->slabBuckets[s->sizeClass][bucket] = s;
+}
+
+/*
+  createSlab takes a SLAB_SIZE aligned run for a new slab of class c from the run tier, or reuses the spare slab of the
+  class. Returns NULL if no run could be had.
+*/
+static slab *createSlab(arena *a, int c){
+  slab *s;
+  if(a->spareSlabs[c] != NULL){
+    s = a->spareSlabs[c];
+    a->spareSlabs[c] = NULL;
+    return s;
+  }
+  s = runAlloc(a, SLAB_SIZE, SLAB_SIZE / PAGE_SIZE);
+  if(s == NULL){
+    return NULL;
+  }
+  s->freeObjects = NULL;
+  s->objectSize = classSizes[c];
+  s->sizeClass = (unsigned short) c;
+  s->used = 0;
+  s->carved = 0;
+  s->capacity = (unsigned short) ((SLAB_SIZE - SLAB_HEADER_SIZE) / s->objectSize);
+  s->bucket = SLAB_FULL;
+  return s;
+}
+
+/*
+  slabAlloc returns an object of size bytes from the fullest partially used slab of its class, creating a slab if the
+  class has none. Returns NULL if no slab could be created.
+*/
+static void *slabAlloc(arena *a, size_t size){
+  int c, b;
+  slab *s;
+  void *object;
+  c = sizeClassOf(size);
+  s = NULL;
+  for(b = SLAB_BUCKETS - 1; b >= 0 && s == NULL; b--){
+    s = a->slabBuckets[c][b];
+  }
+  if(s == NULL){
+    s = createSlab(a, c);
+    if(s == NULL){
+      return NULL;
+    }
+  }
+  //Reuse a freed object if there is one, otherwise carve the next untouched one
+  if(s->freeObjects != NULL){
+    object = s->freeObjects;
+    s->freeObjects = *((void **) object);
+  }
+  else{
+    object = ((void *) s) + SLAB_HEADER_SIZE + s->carved * s->objectSize;
+    s->carved++;
+  }
+  s->used++;
+  placeSlab(a, s);
+  return object;
 }
 
+/*
+  slabFree puts the object at ptr back on the free list of its slab. A slab that becomes empty is kept as the spare of its
+  class or, if the class already has one, handed back to the run tier.
+*/
+static void slabFree(arena *a, void *ptr){
+  slab *s = slabOf(ptr);
+  *((void **) ptr) = s->freeObjects;
+  s->freeObjects = ptr;
+  s->used--;
+  if(s->used == 0){
+    unlinkSlab(a, s);
+    if(a->spareSlabs[s->sizeClass] == NULL){
+      a->spareSlabs[s->sizeClass] = s;
+    }
+    else{
+      runFree(a, s);
+    }
+    return;
+  }
+  placeSlab(a, s);
+}
+
+/*
+  unmapSlabs forgets all slabs. It is called when every allocation has been freed, right before unmapRunChunks releases
+  the memory of the remaining spare slabs.
+*/
+static void unmapSlabs(arena *a){
+  int c, b;
+  for(c = 0; c < SIZE_CLASSES; c++){
+    for(b = 0; b < SLAB_BUCKETS; b++){
+      a->slabBuckets[c][b] = NULL;
+    }
+    a->spareSlabs[c] = NULL;
+  }
+}
+
+/*
+  usableSize returns the number of bytes the block at ptr can hold, whichever tier it comes from.
+*/
+static size_t usableSize(void *ptr){
+  if(chunkKind(ptr) == CHUNK_RUNS){
+    if(isSlabObject(ptr)){
+      return slabOf(ptr)->objectSize;
+    }
+    return runSize(ptr);
+  }
+  return ((node*) (ptr - sizeof(node)))->size - sizeof(node);
+}
+/*
+  ownerOf returns the arena the allocated block at ptr belongs to.
+*/
+static arena *ownerOf(void *ptr){
+  if(chunkKind(ptr) == CHUNK_RUNS){
+    return ((runChunk *) (((size_t) ptr) & ~(MIN_SIZE - 1)))->arena;
+  }
+  return ((node*) (ptr - sizeof(node)))->arena;
+}
+
+/*
+  Threads start out in the least loaded arena. A thread that finds the lock of its arena taken moves to a new arena,
+  as long as there are fewer than arenaLimit of them, or else to the least loaded other arena. The limit is
+  ARENAS_PER_CPU arenas per CPU the process may run on, up to MAX_ARENAS. Arenas are never destroyed, and the number of
+  threads bound to each is kept up to date through the destructor of arenaKey when threads exit.
+*/
+#define MAX_ARENAS 64
+#define ARENAS_PER_CPU 4
+arena arenas[MAX_ARENAS];
+int arenaCount = 0;
+int arenaLimit = 0;
+pthread_mutex_t arenasLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t arenaKey;
+//Set from MEMORY_LIFETIME, see __malloc_site_impl
+int lifetimePrediction = 0;
+pthread_mutex_t samplesLock = PTHREAD_MUTEX_INITIALIZER;
+//Set by the first __alloc_tag_push_impl, see tagBlock
+int tagsInUse = 0;
+pthread_mutex_t tagsLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread arena *threadArena __attribute__((tls_model("initial-exec"))) = NULL;
+
+/*
+  lockArena locks arena a, queueing with waiter if the lock is a queue lock. Returns 1 if the lock was taken by another
+  thread and had to be waited for, 0 otherwise.
+*/
+static int lockArena(arena *a, lockWaiter *waiter){
+  return acquireLock(&a->lock, waiter);
+}
+
+/*
+  tryLockArena locks arena a if that does not mean waiting for it. Returns 1 if it did, 0 otherwise.
+*/
+static int tryLockArena(arena *a, lockWaiter *waiter){
+  return tryAcquireLock(&a->lock, waiter);
+}
+
+/*
+  unlockArena unlocks arena a, which was locked with waiter.
+*/
+static void unlockArena(arena *a, lockWaiter *waiter){
+  releaseLock(&a->lock, waiter);
+}
+
+/*
+  countArenaLimit returns the maximum number of arenas for the CPUs the process may run on.
+*/
+static int countArenaLimit(){
+  cpu_set_t cpus;
+  int limit = 1;
+  if(sched_getaffinity(0, sizeof(cpus), &cpus) == 0){
+    limit = CPU_COUNT(&cpus);
+  }
+  limit *= ARENAS_PER_CPU;
+  if(limit > MAX_ARENAS){
+    limit = MAX_ARENAS;
+  }
+  return limit;
+}
+
+/*
+  newArena sets up the next unused arena. Returns NULL if arenaLimit arenas exist already. Must be called with
+  arenasLock held.
+*/
+static arena *newArena(){
+  arena *a;
+  if(arenaCount >= arenaLimit){
+    return NULL;
+  }
+  a = &arenas[arenaCount];
+  initLock(&a->lock);
+  __atomic_store_n(&arenaCount, arenaCount + 1, __ATOMIC_RELEASE);
+  return a;
+}
+
+/*
+  leastLoadedArena returns the arena other than except with the fewest threads bound to it, or NULL if there is no other
+  arena. Arenas of lifetime hints are not considered. Must be called with arenasLock held.
+*/
+static arena *leastLoadedArena(arena *except){
+  arena *best = NULL;
+  int i;
+  for(i = 0; i < arenaCount; i++){
+    if(&arenas[i] != except && !arenas[i].lifetime && (best == NULL || arenas[i].threads < best->threads)){
+      best = &arenas[i];
+    }
+  }
+  return best;
+}
+
+/*
+  bindArena binds the calling thread to arena a, moving it out of the arena it was bound to. Must be called with
+  arenasLock held.
+*/
+static void bindArena(arena *a){
+  if(threadArena != NULL){
+    threadArena->threads--;
+  }
+  a->threads++;
+  threadArena = a;
+}
+
+static void closeThreadCache();
+
+/*
+  unbindArena is the destructor of arenaKey: it gives the thread cache of an exiting thread back to the arenas and takes
+  the thread out of the count of its arena.
+*/
+static void unbindArena(void *a){
+  closeThreadCache();
+  retireTagCounters();
+  pthread_mutex_lock(&arenasLock);
+  ((arena *) a)->threads--;
+  pthread_mutex_unlock(&arenasLock);
+}
+
+/*
+  currentArena returns the arena the calling thread is bound to, binding it to the least loaded arena on its first call.
+  The first call in the process sets up the first arena, reads MEMORY_BACKGROUND and MEMORY_LIFETIME and installs the
+  fork handlers.
+*/
+static arena *currentArena(){
+  char *setting;
+  int first = 0;
+  if(threadArena != NULL){
+    return threadArena;
+  }
+  pthread_mutex_lock(&arenasLock);
+  if(arenaCount == 0){
+    setting = getenv("MEMORY_BACKGROUND");
+    backgroundMaintenance = setting != NULL && strcmp(setting, "yes") == 0;
+    setting = getenv("MEMORY_LIFETIME");
+    lifetimePrediction = setting != NULL && strcmp(setting, "yes") == 0;
+    arenaLimit = countArenaLimit();
+    pthread_key_create(&arenaKey, unbindArena);
+    newArena();
+    first = 1;
+  }
+  //A thread that was not started through the pthread_create wrapper, see multiThreaded
+  else if(!__atomic_load_n(&multiThreaded, __ATOMIC_RELAXED)){
+    __threads_started_impl();
+  }
+  bindArena(leastLoadedArena(NULL));
+  pthread_mutex_unlock(&arenasLock);
+  //Registering the thread for unbindArena may allocate, which is fine now that the thread has an arena
+  pthread_setspecific(arenaKey, threadArena);
+  //So may installing the fork handlers. The child of a fork inherits them along with the arenas and never gets here
+  if(first){
+    pthread_atfork(prepareFork, parentAfterFork, childAfterFork);
+  }
+  if(backgroundMaintenance){
+    wakeReclaimer();
+  }
+  return threadArena;
+}
+
+/*
+  leaveArena moves the calling thread, which found the lock of its arena contended, to a new arena or, when no more
+  arenas may be created, to the least loaded other one.
+*/
+static void leaveArena(){
+  arena *a;
+  pthread_mutex_lock(&arenasLock);
+  a = newArena();
+  if(a == NULL){
+    a = leastLoadedArena(threadArena);
+  }
+  if(a != NULL){
+    bindArena(a);
+  }
+  pthread_mutex_unlock(&arenasLock);
+  pthread_setspecific(arenaKey, threadArena);
+}
+
+/*
+  blockSizeFor returns the size of the free list block for a request of size bytes: the header is added and the sum is
+  rounded up to a multiple of the header size, so every block stays aligned. Returns 0 if the addition overflows.
+*/
+static size_t blockSizeFor(size_t size){
+  size_t sizeofBlock = (size + 2 * sizeof(node) - 1) & ~(sizeof(node) - 1);
+  if(sizeofBlock < size){
+    return 0;
+  }
+  return sizeofBlock;
+}
+
+/*
+  roundedSize returns the number of bytes usableSize reports for a block that malloc returns for a request of size bytes:
+  the size of its class for small requests, whole pages for medium ones and the block size less the header otherwise.
+  Blocks from the free list are split exactly, so the result does not depend on the block the request ends up in.
+  Returns 0 if size is 0 or too large to be served.
+*/
+static size_t roundedSize(size_t size){
+  if(size == 0){
+    return 0;
+  }
+  if(size <= SLAB_MAX_SIZE){
+    return classSizes[sizeClassOf(size)];
+  }
+  if(size >= RUN_MIN_SIZE && size <= RUN_MAX_SIZE){
+    return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+  }
+  if(blockSizeFor(size) == 0){
+    return 0;
+  }
+  return blockSizeFor(size) - sizeof(node);
+}
+
+/*
+  arenaMalloc does the work of __malloc_impl within arena a, which the caller has locked. It accepts 
+  a size in bytes and returns a pointer to a free memory block of the requested size. This is accomplished by 
+  searching the list of free memory nodes for a node of sufficent size. If no node of sufficent size is found, 
+  one of greater size is created using the above createBlocks function and a slice of requested size is returned. 
+  Each node contains a header populated with information about the node, namely the size and pointers to next and
+  previous nodes. arenaMalloc returns a void pointer to the free memory immediately following the header, 
+  denoted startofFreeBlock. 
+
+*/
+static void *arenaMalloc(arena *a, size_t size) {
+  //Handle case where requested size is 0
+  size_t sizeofBlock;
+  node *ptr;
+  void* startofFreeBlock;
+  if(size == (size_t) 0){
+    return NULL;
+  }
+  //Small requests are served from slabs and medium requests as page runs, away from the free list
+  if(size <= SLAB_MAX_SIZE){
+    startofFreeBlock = slabAlloc(a, size);
+    if(startofFreeBlock != NULL){
+      a->numAllocations++;
+    }
+    return startofFreeBlock;
+  }
+  if(size >= RUN_MIN_SIZE && size <= RUN_MAX_SIZE){
+    startofFreeBlock = runAlloc(a, size, 1);
+    if(startofFreeBlock != NULL){
+      a->numAllocations++;
+    }
+    return startofFreeBlock;
+  }
+  sizeofBlock = blockSizeFor(size);
+   //Return NULL is addition overflows
+  if(sizeofBlock == 0){
+    return NULL;
+  }
+  ptr = searchList(a, sizeofBlock);
+  if(ptr != NULL){
+    //Found a block of sufficent size, account for header
+    startofFreeBlock = ((void*) ptr) + sizeof(node);
+    //ptr has been allocated and so remove from list
+    removeNode(a, ptr);
+    ptr->arena = a;
+    //prev is not used while the block is allocated and holds its allocation tag instead, see tagOf
+    ptr->prev = NULL;
+    //Increment the arena counter numAllocations for the purpose of determining if every allocated node has been freed
+    a->numAllocations++;
+    return startofFreeBlock;
+  }
+  //If no block of the right size is in the list, carve one from the wilderness, which is not part of the list.
+  //If that is too small as well, the caller refills the arena and tries again, see refillArena
+  ptr = topAlloc(a, sizeofBlock);
+  if(ptr != NULL){
+    startofFreeBlock = ((void*) ptr) + sizeof(node);
+    ptr->arena = a;
+    ptr->prev = NULL;
+    a->numAllocations++;  
+    return startofFreeBlock;
+  }
+  //If any errors occured and no blocks where found, return NULL
+  return NULL;
+}
+
+/*
+  An arena that runs out of memory first looks for memory that other arenas hold but do not use before it maps any: when
+  the threads of a process move from one arena to another, the memory of the arenas they left would otherwise sit idle
+  while the new ones keep mapping. Only whole spans that no allocated block lies in are taken, so that ownerOf stays
+  right for every block: run chunks that are entirely free, and the wilderness. A wilderness is only taken from its first
+  page boundary on, as the blocks below it may be released page by page; the bytes before the boundary stay with the
+  donor. Donors whose lock is taken are skipped rather than waited for, as they are in use anyway.
+*/
+
+/*
+  stealRunChunk moves a run chunk without any allocated pages from another arena to arena a, which is not locked.
+  Returns 0 if a chunk was moved and -1 otherwise.
+*/
+static int stealRunChunk(arena *a){
+  arena *donor;
+  runChunk *chunk = NULL;
+  lockWaiter waiter;
+  int i, count;
+  count = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+  for(i = 0; i < count && chunk == NULL; i++){
+    donor = &arenas[i];
+    if(donor == a || !tryLockArena(donor, &waiter)){
+      continue;
+    }
+    for(chunk = donor->runChunks; chunk != NULL; chunk = chunk->next){
+      if(chunk->freePages == PAGES_PER_CHUNK - HEADER_PAGES){
+        unlinkRunChunk(donor, chunk);
+        break;
+      }
+    }
+    unlockArena(donor, &waiter);
+  }
+  if(chunk == NULL){
+    return -1;
+  }
+  chunk->arena = a;
+  lockArena(a, &waiter);
+  publishRunChunk(a, chunk);
+  unlockArena(a, &waiter);
+  return 0;
+}
+
+/*
+  stealTop moves the part of the wilderness of another arena that starts at its first page boundary to arena a, which
+  is not locked, if it can hold a block of need bytes. Returns 0 if it was moved and -1 otherwise.
+*/
+static int stealTop(arena *a, size_t need){
+  arena *donor;
+  void *start = NULL, *end = NULL;
+  lockWaiter waiter;
+  int i, count;
+  count = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+  for(i = 0; i < count && start == NULL; i++){
+    donor = &arenas[i];
+    if(donor == a || !tryLockArena(donor, &waiter)){
+      continue;
+    }
+    if(donor->topStart != NULL){
+      start = (void *) ((((size_t) donor->topStart) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+      if(start < donor->topEnd && (size_t) (donor->topEnd - start) >= need){
+        end = donor->topEnd;
+        donor->topEnd = start;
+      }
+      else{
+        start = NULL;
+      }
+    }
+    unlockArena(donor, &waiter);
+  }
+  if(start == NULL){
+    return -1;
+  }
+  lockArena(a, &waiter);
+  publishTop(a, start, end - start, need);
+  unlockArena(a, &waiter);
+  return 0;
+}
+
+/*
+  refillRuns adds a run chunk to arena a, which is not locked, for refillArena. Returns 0 if a chunk was added and -1
+  otherwise.
+*/
+static int refillRuns(arena *a){
+  runChunk *chunk;
+  lockWaiter waiter;
+  if(stealRunChunk(a) == 0){
+    return 0;
+  }
+  chunk = createRunChunk(a);
+  if(chunk == NULL){
+    return -1;
+  }
+  lockArena(a, &waiter);
+  publishRunChunk(a, chunk);
+  unlockArena(a, &waiter);
+  return 0;
+}
+
+/*
+  refillTop makes the wilderness of arena a, which is not locked, hold a block of need bytes, for refillArena. Returns 0
+  if memory was added and -1 otherwise.
+*/
+static int refillTop(arena *a, size_t need, void *hint){
+  void *p;
+  size_t mapped;
+  lockWaiter waiter;
+  if(need == 0){
+    return -1;
+  }
+  if(stealTop(a, need) == 0){
+    return 0;
+  }
+  p = createBlock(need, hint, &mapped);
+  if(p == NULL){
+    return -1;
+  }
+  lockArena(a, &waiter);
+  publishTop(a, p, mapped, need);
+  unlockArena(a, &waiter);
+  return 0;
+}
+
+/*
+  refillArena adds memory to arena a after arenaMalloc failed to serve a request of size bytes from it: a run chunk for
+  small and medium requests and a new wilderness, or an extension of the current one at hint, for the others. The memory
+  is taken from another arena if one has it to spare, see stealRunChunk and stealTop. Otherwise it is mapped without the
+  lock of the arena held, so other threads keep using the arena during the system call, and then published to the arena
+  under its lock. Returns 0 if memory was added and -1 otherwise.
+*/
+static int refillArena(arena *a, size_t size, void *hint){
+  if(size <= SLAB_MAX_SIZE || (size >= RUN_MIN_SIZE && size <= RUN_MAX_SIZE)){
+    return refillRuns(a);
+  }
+  return refillTop(a, blockSizeFor(size), hint);
+}
+
+/*
+  releaseArena releases all memory of arena a, which has no allocated blocks left.
+*/
+static void releaseArena(arena *a){
+  //Call mergeBlocks one final time to ensure the list is an condensed as possible
+  mergeBlocks(a);
+  unmapBlocks(a);
+  unmapTop(a);
+  unmapSlabs(a);
+  unmapRunChunks(a);
+}
+
+/*
+  arenaFree does the work of __free_impl within arena a, the arena the block at ptr came from, which the caller has
+  locked. The block is given back to its tier. A check is made if the number of allocations from the arena is equal
+  to the number of blocks freed to it, and if so, all of the arena's memory is released. With backgroundMaintenance,
+  coalescing the free list and releasing the arena are left to maintainArena. The free list memory of a private heap is
+  only released by heapDestroy, so a private heap is never released here.
+
+*/
+static void arenaFree(arena *a, void *ptr){
+   //Increment the arena counter numFreed to check if all nodes have been freed
+   a->numFreed++;
+   //Small objects go back to their slab and medium blocks to their run chunk
+   if(chunkKind(ptr) == CHUNK_RUNS){
+     if(isSlabObject(ptr)){
+       slabFree(a, ptr);
+     }
+     else{
+       runFree(a, ptr);
+     }
+   }
+   else{
+     //Retrieve header
+     node* freeBlock = (node*)(ptr - sizeof(node));
+     insertNode(a, freeBlock);
+     if(!backgroundMaintenance || a->privateHeap){
+       mergeBlocks(a);
+     }
+     absorbIntoTop(a);
+   }
+   if(a->numFreed == a->numAllocations && !backgroundMaintenance && !a->privateHeap){
+     releaseArena(a);
+   }
+}
+
+/*
+  Small objects first go through two caches in front of the arenas. Every thread keeps the small objects it frees in
+  its own thread cache, a free list per size class that needs no lock at all, and allocates from it. A thread cache holds
+  at most TCACHE_MAX objects of a class. When it overflows, BATCH_OBJECTS of them are moved, as one pre-linked batch, to
+  the transfer cache of the class, shared by all threads; when it runs empty, a whole batch is taken from there. Threads
+  that allocate and threads that free thus trade batches in a single short operation, and the arenas only see one call
+  per batch: refills that find the transfer cache empty carve BATCH_OBJECTS from a slab under one arena lock, and
+  batches that do not fit the full transfer cache are freed to their arenas. Objects in either cache still count as
+  allocated for their arena. Batches and thread caches are chained through the first word of the objects.
+
+  The transfer caches are lock-free: each is a Treiber stack of batches, linked through the second word of the first
+  object of each batch, so taking or putting a batch is a single compare and swap on the top of the stack. To protect
+  against ABA, where a batch is taken and put back between the read of the top and the compare and swap of another
+  thread, the top carries a tag that every change increments: user space addresses fit in the low TAG_SHIFT bits, the
+  tag takes the bits above. takeBatch reads the link of a batch it does not own yet, so the memory of a batch must stay
+  mapped while a take is under way; takes are counted in stackReaders, and the reclaimer waits for it to drop to zero
+  before it unmaps anything.
+*/
+#define TCACHE_MAX 64
+#define BATCH_OBJECTS 32
+#define TRANSFER_BATCHES 64
+
+typedef struct tcacheBin{
+  void *objects;
+  int count;
+}tcacheBin;
+
+typedef struct transferCache{
+  unsigned long long top;
+  int count;
+}transferCache;
+
+#define TAG_SHIFT 48
+#define POINTER_MASK ((1ULL << TAG_SHIFT) - 1)
+
+static __thread tcacheBin tcache[SIZE_CLASSES] __attribute__((tls_model("initial-exec")));
+//Set once unbindArena has flushed the thread cache of an exiting thread, see closeThreadCache
+static __thread int tcacheClosed __attribute__((tls_model("initial-exec"))) = 0;
+transferCache transferCaches[SIZE_CLASSES];
+
+/*
+  takeBatch takes a batch of BATCH_OBJECTS objects of class c from the transfer cache. Returns NULL if there is none.
+*/
+static void *takeBatch(int c){
+  transferCache *t = &transferCaches[c];
+  unsigned long long top, newTop;
+  void *batch;
+  __atomic_add_fetch(&stackReaders, 1, __ATOMIC_SEQ_CST);
+  top = __atomic_load_n(&t->top, __ATOMIC_ACQUIRE);
+  do{
+    batch = (void *) (size_t) (top & POINTER_MASK);
+    if(batch == NULL){
+      break;
+    }
+    newTop = (((top >> TAG_SHIFT) + 1) << TAG_SHIFT) | (size_t) ((void **) batch)[1];
+  }while(!__atomic_compare_exchange_n(&t->top, &top, newTop, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  __atomic_sub_fetch(&stackReaders, 1, __ATOMIC_SEQ_CST);
+  if(batch != NULL){
+    __atomic_sub_fetch(&t->count, 1, __ATOMIC_RELAXED);
+  }
+  return batch;
+}
+
+/*
+  putBatch puts a batch of BATCH_OBJECTS objects of class c in the transfer cache. Returns 0 if the transfer cache
+  already holds TRANSFER_BATCHES batches, in which case the batch is left to the caller.
+*/
+static int putBatch(int c, void *batch){
+  transferCache *t = &transferCaches[c];
+  unsigned long long top, newTop;
+  if(__atomic_fetch_add(&t->count, 1, __ATOMIC_RELAXED) >= TRANSFER_BATCHES){
+    __atomic_sub_fetch(&t->count, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  top = __atomic_load_n(&t->top, __ATOMIC_ACQUIRE);
+  do{
+    ((void **) batch)[1] = (void *) (size_t) (top & POINTER_MASK);
+    newTop = (((top >> TAG_SHIFT) + 1) << TAG_SHIFT) | (size_t) batch;
+  }while(!__atomic_compare_exchange_n(&t->top, &top, newTop, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+  return 1;
+}
+
+/*
+  freeChain frees the chained objects starting at objects to their arenas. Runs of objects from the same arena are freed
+  under a single lock of that arena.
+*/
+static void freeChain(void *objects){
+  arena *a, *locked = NULL;
+  lockWaiter waiter = {0};
+  void *next;
+  while(objects != NULL){
+    next = *((void **) objects);
+    a = ownerOf(objects);
+    if(a != locked){
+      if(locked != NULL){
+        unlockArena(locked, &waiter);
+      }
+      lockArena(a, &waiter);
+      locked = a;
+    }
+    arenaFree(a, objects);
+    objects = next;
+  }
+  if(locked != NULL){
+    unlockArena(locked, &waiter);
+  }
+}
+
+/*
+  fillFromArena carves up to BATCH_OBJECTS objects of class c from the slabs of the arena of the calling thread into
+  bin, under one lock of the arena. Returns the number of objects carved, which is 0 if the arena needs refilling.
+*/
+static int fillFromArena(int c, tcacheBin *bin){
+  arena *a;
+  lockWaiter waiter;
+  void *object;
+  int n, contended;
+  a = currentArena();
+  contended = lockArena(a, &waiter);
+  for(n = 0; n < BATCH_OBJECTS; n++){
+    object = slabAlloc(a, classSizes[c]);
+    if(object == NULL){
+      break;
+    }
+    *((void **) object) = bin->objects;
+    bin->objects = object;
+  }
+  a->numAllocations += n;
+  bin->count += n;
+  unlockArena(a, &waiter);
+  if(contended){
+    leaveArena();
+  }
+  return n;
+}
+
+/*
+  cacheAlloc returns an object for a small request of size bytes from the thread cache, refilling the thread cache from
+  the transfer cache or the arena if it is empty. Returns NULL if the arena has to be refilled first.
+*/
+static void *cacheAlloc(size_t size){
+  int c;
+  tcacheBin *bin;
+  void *object;
+  c = sizeClassOf(size);
+  bin = &tcache[c];
+  if(bin->count == 0){
+    if(tcacheClosed){
+      return NULL;
+    }
+    //The thread has to be bound to an arena for its cache to be flushed when it exits
+    currentArena();
+    bin->objects = takeBatch(c);
+    if(bin->objects != NULL){
+      bin->count = BATCH_OBJECTS;
+    }
+    else if(fillFromArena(c, bin) == 0){
+      return NULL;
+    }
+  }
+  object = bin->objects;
+  bin->objects = *((void **) object);
+  bin->count--;
+  return object;
+}
+
+/*
+  cacheFree puts the small object at ptr, of class c, in the thread cache. If that overflows, a batch of the objects is
+  moved to the transfer cache or, if that is full too, freed to the arenas.
+*/
+static void cacheFree(void *ptr, int c){
+  tcacheBin *bin = &tcache[c];
+  void *batch, *last;
+  int i;
+  if(tcacheClosed){
+    *((void **) ptr) = NULL;
+    freeChain(ptr);
+    return;
+  }
+  *((void **) ptr) = bin->objects;
+  bin->objects = ptr;
+  bin->count++;
+  if(bin->count <= TCACHE_MAX){
+    return;
+  }
+  batch = bin->objects;
+  last = batch;
+  for(i = 1; i < BATCH_OBJECTS; i++){
+    last = *((void **) last);
+  }
+  bin->objects = *((void **) last);
+  bin->count -= BATCH_OBJECTS;
+  *((void **) last) = NULL;
+  if(!putBatch(c, batch)){
+    freeChain(batch);
+  }
+}
+
+/*
+  closeThreadCache frees everything in the thread cache of the calling thread, which is exiting, to the arenas and
+  closes the cache. Destructors of other keys and of thread locals may still allocate and free on the thread
+  afterwards; with the cache closed, their small objects come from and go straight back to the arenas instead of into a
+  cache that nobody would flush.
+*/
+static void closeThreadCache(){
+  int c;
+  for(c = 0; c < SIZE_CLASSES; c++){
+    freeChain(tcache[c].objects);
+    tcache[c].objects = NULL;
+    tcache[c].count = 0;
+  }
+  tcacheClosed = 1;
+}
+
+/*
+  Threads that cannot afford to wait for a free, which may have to coalesce blocks under the lock of their arena and
+  queue whole mappings for release, can defer it with __free_deferred_impl. Deferred blocks are pushed on deferredQueue,
+  a lock-free stack linked through the first word of the blocks, and freed to their arenas by the reclaimer thread.
+  Small objects are not deferred, as freeing them to the thread cache is already as cheap as queueing them.
+  deferredBytes counts the bytes waiting in the queue. The reclaimer is only signalled when it reaches
+  DEFERRED_WAKE_BYTES, so that deferring does not cost a system call each time the reclaimer has caught up; less than
+  that waits for the next time the reclaimer is woken for any reason. To keep the reclaimer from falling arbitrarily far
+  behind, a thread that pushes deferredBytes beyond DEFERRED_MAX_BYTES drains the queue itself.
+*/
+#define DEFERRED_MAX_BYTES ((size_t) 64 * 1048576)
+#define DEFERRED_WAKE_BYTES ((size_t) 1048576)
+size_t deferredBytes = 0;
+
+/*
+  drainDeferred takes the whole deferred queue at once and frees the blocks on it.
+*/
+static void drainDeferred(){
+  void *objects, *object;
+  size_t bytes = 0;
+  objects = __atomic_exchange_n(&deferredQueue, NULL, __ATOMIC_ACQUIRE);
+  if(objects == NULL){
+    return;
+  }
+  for(object = objects; object != NULL; object = *((void **) object)){
+    bytes += usableSize(object);
+  }
+  freeChain(objects);
+  __atomic_sub_fetch(&deferredBytes, bytes, __ATOMIC_RELAXED);
+}
+
+/*
+  With backgroundMaintenance, the reclaimer runs maintainArenas every MAINTENANCE_INTERVAL_MS milliseconds. Memory that
+  is not used is given back with a delay that depends on how busy its arena is: an arena that has not allocated or
+  freed anything since the previous round is considered idle and gives back everything it does not need, whereas a busy
+  arena keeps one free run chunk, its spare slabs and MIN_SIZE bytes of its wilderness for the allocations to come. An
+  idle arena also unmaps the whole pages inside free blocks of at least PURGE_MIN_SIZE bytes; the bytes before and after
+  them stay free blocks, and the pages are simply no longer part of the arena. The transfer caches are halved every
+  round, so batches that nobody takes decay back to the arenas. Thread caches belong to their threads and are left alone.
+*/
+#define PURGE_MIN_SIZE ((size_t) 1048576)
+
+/*
+  compactFreeBlocks coalesces the free list, or shrinks the free table if it has become mostly empty.
+*/
+static void compactFreeBlocks(arena *a){
+#ifdef FREE_TABLE
+  shrinkTable(a);
+#else
+  mergeBlocks(a);
+#endif
+}
+
+/*
+  purgeFreeBlocks unmaps the whole pages inside the free blocks of arena a that span at least PURGE_MIN_SIZE bytes of
+  them, leaving the parts of the blocks before and after the pages on the free list. Blocks are aligned to the header
+  size, and so are page boundaries, so these parts are either empty or large enough for a header.
+*/
+static void purgeFreeBlocks(arena *a){
+  void *start, *end, *first, *last;
+#ifdef FREE_TABLE
+  size_t i;
+  //Go backwards, so that inserting the part after the pages does not move the entries still to be looked at
+  for(i = a->freeCount; i-- > 0;){
+    start = a->freeTable[i].addr;
+    end = start + a->freeTable[i].size;
+    first = (void *) ((((size_t) start) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    last = (void *) (((size_t) end) & ~(PAGE_SIZE - 1));
+    if(last <= first || (size_t) (last - first) < PURGE_MIN_SIZE){
+      continue;
+    }
+    if(first == start){
+      a->freeTable[i].addr = last;
+      tableSetSize(a, i, end - last);
+      if(last == end){
+        tableRemove(a, i);
+      }
+    }
+    else{
+      tableSetSize(a, i, first - start);
+      if(last < end && tableInsert(a, last, end - last) < 0){
+        tableSetSize(a, i, end - start);
+        continue;
+      }
+    }
+    queueRelease(first, last - first);
+  }
+#else
+  node *block, *next, *tail;
+  for(block = a->head; block != NULL; block = next){
+    next = block->next;
+    start = block;
+    end = start + block->size;
+    first = (void *) ((((size_t) start) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    last = (void *) (((size_t) end) & ~(PAGE_SIZE - 1));
+    if(last <= first || (size_t) (last - first) < PURGE_MIN_SIZE){
+      continue;
+    }
+    if(first == start){
+      removeNode(a, block);
+    }
+    else{
+      block->size = first - start;
+    }
+    if(last < end){
+      tail = (node *) last;
+      tail->size = end - last;
+      insertNode(a, tail);
+    }
+    queueRelease(first, last - first);
+  }
+#endif
+}
+
+/*
+  releaseFreeRunChunks releases the run chunks of arena a without any allocated pages, keeping keep of them.
+*/
+static void releaseFreeRunChunks(arena *a, int keep){
+  runChunk *chunk, *next;
+  for(chunk = a->runChunks; chunk != NULL; chunk = next){
+    next = chunk->next;
+    if(chunk->freePages == PAGES_PER_CHUNK - HEADER_PAGES){
+      if(keep > 0){
+        keep--;
+      }
+      else{
+        releaseRunChunk(a, chunk);
+      }
+    }
+  }
+}
+
+/*
+  maintainArena does one round of housekeeping on arena a, which must not be locked.
+*/
+static void maintainArena(arena *a){
+  lockWaiter waiter;
+  size_t operations;
+  int idle, c;
+  lockArena(a, &waiter);
+  operations = a->numAllocations + a->numFreed;
+  idle = operations == a->seenOperations;
+  a->seenOperations = operations;
+  if(a->numFreed == a->numAllocations){
+    releaseArena(a);
+    unlockArena(a, &waiter);
+    return;
+  }
+  compactFreeBlocks(a);
+  absorbIntoTop(a);
+  if(idle){
+    //Spare slabs go back to the run tier first, so that their chunks can be released along with the others
+    for(c = 0; c < SIZE_CLASSES; c++){
+      if(a->spareSlabs[c] != NULL){
+        runFree(a, a->spareSlabs[c]);
+        a->spareSlabs[c] = NULL;
+      }
+    }
+    trimTop(a, 0);
+    purgeFreeBlocks(a);
+    releaseFreeRunChunks(a, 0);
+  }
+  else{
+    if((size_t) (a->topEnd - a->topStart) > TOP_TRIM_SIZE){
+      trimTop(a, MIN_SIZE);
+    }
+    releaseFreeRunChunks(a, 1);
+  }
+  unlockArena(a, &waiter);
+}
+
+/*
+  maintainArenas halves the transfer caches and does a round of housekeeping on every arena.
+*/
+static void maintainArenas(){
+  int c, n, i, count;
+  void *batch;
+  for(c = 0; c < SIZE_CLASSES; c++){
+    n = (__atomic_load_n(&transferCaches[c].count, __ATOMIC_RELAXED) + 1) / 2;
+    while(n > 0 && (batch = takeBatch(c)) != NULL){
+      freeChain(batch);
+      n--;
+    }
+  }
+  count = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+  for(i = 0; i < count; i++){
+    maintainArena(&arenas[i]);
+  }
+}
+
+/*
+  The fork handlers take every arena lock, the locks of the reclaimer, samplesLock, tagsLock and the locks of the object
+  caches before a fork and give them back afterwards. In the child, which only has the forking thread, the locks and the
+  reclaimer are set up anew rather than released, as other threads may have been queued for them, and the reclaimer is
+  started again when it is next needed.
+*/
+static lockWaiter forkWaiters[MAX_ARENAS];
+
+static void prepareFork(){
+  int i;
+  pthread_mutex_lock(&arenasLock);
+  for(i = 0; i < arenaCount; i++){
+    lockArena(&arenas[i], &forkWaiters[i]);
+  }
+  pthread_mutex_lock(&reclaimLock);
+  pthread_mutex_lock(&samplesLock);
+  pthread_mutex_lock(&tagsLock);
+  lockCaches();
+}
+
+static void parentAfterFork(){
+  int i;
+  unlockCaches();
+  pthread_mutex_unlock(&tagsLock);
+  pthread_mutex_unlock(&samplesLock);
+  pthread_mutex_unlock(&reclaimLock);
+  for(i = arenaCount - 1; i >= 0; i--){
+    unlockArena(&arenas[i], &forkWaiters[i]);
+  }
+  pthread_mutex_unlock(&arenasLock);
+}
+
+static void childAfterFork(){
+  int i;
+  pthread_mutex_init(&reclaimLock, NULL);
+  pthread_cond_init(&reclaimCond, NULL);
+  pthread_mutex_init(&samplesLock, NULL);
+  for(i = 0; i < arenaCount; i++){
+    initLock(&arenas[i].lock);
+  }
+  pthread_mutex_init(&arenasLock, NULL);
+  pthread_mutex_init(&tagsLock, NULL);
+  resetCaches();
+  //Threads that were inside takeBatch at the fork are not in the child to leave it
+  stackReaders = 0;
+  if(reclaimerState == RECLAIMER_RUNNING){
+    reclaimerState = RECLAIMER_IDLE;
+  }
+}
+/*
+  A private heap is an arena of its own for a component that allocates and frees all of its memory from a single thread
+  at a time. It is not among the arenas, so no other thread ever touches it, and it is used without locking. Apart from
+  its run chunks, which are on runChunks, every mapping of a private heap is put on its mappings list, and its free list
+  memory is never unmapped before heapDestroy: the wilderness is not trimmed and the heap is not released when all its
+  blocks have been freed. heapDestroy can thus give back everything at once by releasing the mappings and the run
+  chunks, whatever blocks are still allocated in them, without walking the blocks.
+*/
+#define HEAP_SIZE ((sizeof(arena) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+/*
+  heapRefill is refillArena for the private heap h: a run chunk for small and medium requests and a new wilderness
+  otherwise. The first sizeof(node) bytes of a new wilderness mapping hold its entry on the mappings of h. Returns 0
+  if memory was added and -1 otherwise.
+*/
+static int heapRefill(arena *h, size_t size){
+  runChunk *chunk;
+  releaseRecord *record;
+  void *p;
+  size_t need, mapped;
+  if(size <= SLAB_MAX_SIZE || (size >= RUN_MIN_SIZE && size <= RUN_MAX_SIZE)){
+    chunk = createRunChunk(h);
+    if(chunk == NULL){
+      return -1;
+    }
+    publishRunChunk(h, chunk);
+    return 0;
+  }
+  need = blockSizeFor(size);
+  if(need == 0 || need + sizeof(node) < need){
+    return -1;
+  }
+  p = createBlock(need + sizeof(node), NULL, &mapped);
+  if(p == NULL){
+    return -1;
+  }
+  record = (releaseRecord *) p;
+  record->size = mapped;
+  record->next = h->mappings;
+  h->mappings = record;
+  publishTop(h, p + sizeof(node), mapped - sizeof(node), need);
+  return 0;
+}
+
+/*
+  A region hands out memory by bumping a pointer through chunks from createBlock and takes it all back at once. Objects
+  in a region have no headers and cannot be freed one by one: region_mark remembers the current position, and
+  region_release goes back to it, giving up everything allocated since. Each chunk starts with a regionChunk that links
+  it to the chunk before it; the region itself lives in its first chunk, right after that header, so creating a region
+  maps one chunk and resetting it keeps that chunk. Going back only costs a store unless whole chunks are given up, and
+  one given up chunk of MIN_SIZE bytes is kept as a spare, so that a region that keeps crossing the same chunk boundary
+  does not map and unmap a chunk every time. A region is used by one thread at a time and is never locked.
+*/
+#define REGION_ALIGN ((size_t) 16)
+
+typedef struct regionChunk{
+  struct regionChunk *prev;
+  size_t size;
+}regionChunk;
+
+typedef struct region{
+  regionChunk *chunk;
+  void *next;
+  void *end;
+  regionChunk *spare;
+}region;
+
+//Offset of the first object in the first chunk of a region, after the chunk header and the region
+#define REGION_START ((sizeof(regionChunk) + sizeof(region) + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1))
+
+/*
+  regionGrow makes a chunk that can hold size bytes the current chunk of region r, taking the spare if it is large enough
+  and mapping a new chunk otherwise. Returns 0 on success and -1 if no chunk could be mapped.
+*/
+static int regionGrow(region *r, size_t size){
+  regionChunk *chunk;
+  size_t mapped, need;
+  need = sizeof(regionChunk) + size;
+  if(need < size){
+    return -1;
+  }
+  if(r->spare != NULL && r->spare->size >= need){
+    chunk = r->spare;
+    r->spare = NULL;
+  }
+  else{
+    chunk = createBlock(need, NULL, &mapped);
+    if(chunk == NULL){
+      return -1;
+    }
+    chunk->size = mapped;
+  }
+  chunk->prev = r->chunk;
+  r->chunk = chunk;
+  r->next = ((void *) chunk) + sizeof(regionChunk);
+  r->end = ((void *) chunk) + chunk->size;
+  return 0;
+}
+
+/*
+  regionDrop gives up the current chunk of region r, keeping it as the spare if it is an ordinary MIN_SIZE chunk and
+  there is no spare yet, and makes the chunk before it current.
+*/
+static void regionDrop(region *r){
+  regionChunk *chunk = r->chunk;
+  r->chunk = chunk->prev;
+  r->end = ((void *) r->chunk) + r->chunk->size;
+  if(r->spare == NULL && chunk->size == MIN_SIZE){
+    r->spare = chunk;
+  }
+  else{
+    queueRelease(chunk, chunk->size);
+  }
+}
+
+/*
+  Callers that allocate or free many blocks at once can do so with __malloc_batch_impl and __free_batch_impl, which lock
+  an arena once for all of the blocks they handle in it rather than once per block. Blocks freed as a batch are sorted by
+  address first: blocks of the same arena then mostly come in long runs, and the free list blocks of a run are merged
+  into the free list in one walk, followed by a single mergeBlocks. Small objects freed as a batch go straight back to
+  their slabs rather than through the thread cache, which a large batch would only overflow.
+*/
+
+/*
+  sortPointers sorts the count pointers in ptrs by ascending address, in place with a heapsort, so that nothing is
+  allocated while sorting.
+*/
+static void sortPointers(void **ptrs, size_t count){
+  size_t start, end, root, child;
+  void *tmp;
+  if(count < 2){
+    return;
+  }
+  for(start = count / 2, end = count; end > 1;){
+    if(start > 0){
+      start--;
+    }
+    else{
+      end--;
+      tmp = ptrs[0];
+      ptrs[0] = ptrs[end];
+      ptrs[end] = tmp;
+    }
+    //Sift the root of the heap ptrs[start..end) down into place
+    for(root = start; (child = 2 * root + 1) < end; root = child){
+      if(child + 1 < end && ptrs[child + 1] > ptrs[child]){
+        child++;
+      }
+      if(ptrs[root] >= ptrs[child]){
+        break;
+      }
+      tmp = ptrs[root];
+      ptrs[root] = ptrs[child];
+      ptrs[child] = tmp;
+    }
+  }
+}
+
+/*
+  arenaFreeSorted does the work of arenaFree for the count blocks in ptrs, sorted by ascending address, which all belong
+  to arena a, which the caller has locked. The free list blocks are collected at the front of ptrs and inserted together,
+  so ptrs is overwritten.
+*/
+static void arenaFreeSorted(arena *a, void **ptrs, size_t count){
+  size_t i, blocks = 0;
+  a->numFreed += count;
+  for(i = 0; i < count; i++){
+    if(chunkKind(ptrs[i]) == CHUNK_RUNS){
+      if(isSlabObject(ptrs[i])){
+        slabFree(a, ptrs[i]);
+      }
+      else{
+        runFree(a, ptrs[i]);
+      }
+    }
+    else{
+      ptrs[blocks++] = ptrs[i] - sizeof(node);
+    }
+  }
+  if(blocks > 0){
+    insertNodes(a, (node **) ptrs, blocks);
+    if(!backgroundMaintenance || a->privateHeap){
+      mergeBlocks(a);
+    }
+    absorbIntoTop(a);
+  }
+  if(a->numFreed == a->numAllocations && !backgroundMaintenance && !a->privateHeap){
+    releaseArena(a);
+  }
+}
+
+/*
+  batchRefillSize returns the size to refill arena a with when count more blocks of size bytes are still wanted. Sizes
+  served from the free list get room for all of them in one mapping, as long as the total stays beyond the run sizes.
+*/
+static size_t batchRefillSize(size_t size, size_t count){
+  size_t total;
+  if(size <= SLAB_MAX_SIZE || (size >= RUN_MIN_SIZE && size <= RUN_MAX_SIZE) || blockSizeFor(size) == 0){
+    return size;
+  }
+  if(!__try_size_t_multiply(&total, count, blockSizeFor(size)) || total <= RUN_MAX_SIZE){
+    return size;
+  }
+  return total - sizeof(node);
+}
+
+/*
+  Aligned requests are served from whichever tier already hands out blocks with the alignment. Slab objects lie at
+  SLAB_HEADER_SIZE plus a multiple of their class size from a SLAB_SIZE aligned slab, so for alignments up to
+  SLAB_HEADER_SIZE, cache lines included, every object of a class that is a multiple of the alignment is aligned and
+  small requests simply take such a class. Runs start on a page and are found at any multiple of pages by findRun, so
+  page aligned requests of up to RUN_MAX_SIZE bytes, and medium requests with any alignment up to a page, are runs. All
+  other requests are carved out of the free list or the wilderness: a block with room for the alignment is taken, and the
+  bytes before the aligned header and after the requested size go back to the free list as blocks of their own, so at
+  most the alignment is set aside temporarily rather than a whole chunk.
+*/
+
+/*
+  alignedClassOf returns the smallest size class that holds size bytes and is a multiple of align, a power of two of at
+  most SLAB_HEADER_SIZE, or SIZE_CLASSES if no class does.
+*/
+static int alignedClassOf(size_t size, size_t align){
+  int c;
+  for(c = sizeClassOf(size); c < SIZE_CLASSES && classSizes[c] % align != 0; c++){
+  }
+  return c;
+}
+
+/*
+  alignedInRuns tells whether a request of size bytes aligned to align is served as a run.
+*/
+static int alignedInRuns(size_t size, size_t align){
+  if(size > RUN_MAX_SIZE || align > RUN_MAX_SIZE){
+    return 0;
+  }
+  return align >= PAGE_SIZE || size >= RUN_MIN_SIZE;
+}
+
+/*
+  alignedNeed returns the size of the block to carve from the free list for a request of size bytes aligned to align:
+  aligned headers are at most align - sizeof(node) bytes into a block. Returns 0 if that overflows.
+*/
+static size_t alignedNeed(size_t size, size_t align){
+  size_t sizeofBlock, need;
+  sizeofBlock = blockSizeFor(size);
+  need = sizeofBlock + align - sizeof(node);
+  if(sizeofBlock == 0 || need < sizeofBlock){
+    return 0;
+  }
+  return need;
+}
+
+/*
+  alignedInClass tells whether a request of size bytes aligned to align is served from the slab class alignedClassOf.
+*/
+static int alignedInClass(size_t size, size_t align){
+  return size <= SLAB_MAX_SIZE && align <= SLAB_HEADER_SIZE;
+}
+
+/*
+  arenaAlignedMalloc does the work of arenaMalloc for a request aligned to align within arena a, which the caller has
+  locked. Alignments of up to 16 bytes need nothing beyond arenaMalloc. Returns NULL if the arena has to be refilled
+  first, see refillAligned.
+*/
+static void *arenaAlignedMalloc(arena *a, size_t size, size_t align){
+  node *block, *tail;
+  void *ptr;
+  size_t sizeofBlock, need, lead;
+  if(align <= 16){
+    return arenaMalloc(a, size);
+  }
+  if(alignedInClass(size, align)){
+    return arenaMalloc(a, classSizes[alignedClassOf(size, align)]);
+  }
+  if(alignedInRuns(size, align)){
+    ptr = runAlloc(a, size, align > PAGE_SIZE ? align / PAGE_SIZE : 1);
+    if(ptr != NULL){
+      a->numAllocations++;
+    }
+    return ptr;
+  }
+  sizeofBlock = blockSizeFor(size);
+  need = alignedNeed(size, align);
+  if(need == 0){
+    return NULL;
+  }
+  block = searchList(a, need);
+  if(block != NULL){
+    removeNode(a, block);
+  }
+  else{
+    block = topAlloc(a, need);
+    if(block == NULL){
+      return NULL;
+    }
+  }
+  //Blocks are aligned to sizeof(node), so a lead is either empty or large enough for a block of its own
+  ptr = (void *) ((((size_t) block) + sizeof(node) + align - 1) & ~(align - 1));
+  lead = (ptr - sizeof(node)) - (void *) block;
+  if(lead > 0){
+    ((node *) (ptr - sizeof(node)))->size = block->size - lead;
+    block->size = lead;
+    insertNode(a, block);
+    block = (node *) (ptr - sizeof(node));
+  }
+  if(block->size - sizeofBlock >= sizeof(node)){
+    tail = (node *) (((void *) block) + sizeofBlock);
+    tail->size = block->size - sizeofBlock;
+    block->size = sizeofBlock;
+    insertNode(a, tail);
+  }
+  block->arena = a;
+  block->prev = NULL;
+  a->numAllocations++;
+  if(!backgroundMaintenance || a->privateHeap){
+    mergeBlocks(a);
+  }
+  absorbIntoTop(a);
+  return ptr;
+}
+
+/*
+  refillAligned refills arena a, which is not locked, after arenaAlignedMalloc failed to serve a request of size bytes
+  aligned to align from it, with hint as for refillArena. Returns 0 if memory was added and -1 otherwise.
+*/
+static int refillAligned(arena *a, size_t size, size_t align, void *hint){
+  if(align <= 16 || alignedInClass(size, align)){
+    return refillArena(a, size, hint);
+  }
+  if(alignedInRuns(size, align)){
+    return refillRuns(a);
+  }
+  return refillTop(a, alignedNeed(size, align), hint);
+}
+
+/*
+  mallocIn returns a block of size bytes aligned to align from arena a, bypassing the thread cache, and refills the
+  arena until the request is served. Returns NULL if no memory could be had. *contended is set if the lock of the arena
+  had to be waited for.
+*/
+static void *mallocIn(arena *a, size_t size, size_t align, int *contended){
+  lockWaiter waiter;
+  void *ptr, *hint;
+  *contended = lockArena(a, &waiter);
+  ptr = arenaAlignedMalloc(a, size, align);
+  hint = a->topEnd;
+  unlockArena(a, &waiter);
+  while(ptr == NULL && refillAligned(a, size, align, hint) == 0){
+    lockArena(a, &waiter);
+    ptr = arenaAlignedMalloc(a, size, align);
+    hint = a->topEnd;
+    unlockArena(a, &waiter);
+  }
+  wakeReclaimer();
+  return ptr;
+}
+
+/*
+  roundedAlignedSize returns what roundedSize does for a request of size bytes aligned to align.
+*/
+static size_t roundedAlignedSize(size_t size, size_t align){
+  if(align <= 16 || size == 0){
+    return roundedSize(size);
+  }
+  if(alignedInClass(size, align)){
+    return classSizes[alignedClassOf(size, align)];
+  }
+  if(alignedInRuns(size, align)){
+    return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+  }
+  if(alignedNeed(size, align) == 0){
+    return 0;
+  }
+  return blockSizeFor(size) - sizeof(node);
+}
+
+/*
+  The flags of __mallocx_impl, __rallocx_impl and __dallocx_impl follow the layout of jemalloc's: the low bits hold the
+  base 2 logarithm of the alignment, MALLOCX_ZERO asks for zeroed memory, MALLOCX_TCACHE_NONE bypasses the thread cache
+  and MALLOCX_ARENA selects an arena by index. On top of those, MALLOCX_SHORT_LIVED and MALLOCX_LONG_LIVED tell how long
+  the block is expected to live. Each lifetime has an arena of its own, which no thread is bound to, so that blocks kept
+  for long are packed together instead of each pinning a slab or a run chunk that the churn of short-lived blocks around
+  it would otherwise give back. Hinted and selected requests are served from their arena directly rather than through
+  the thread cache, whose objects come from any arena; freeing them with __dallocx_impl and the same flags also keeps
+  them out of the thread cache.
+*/
+#define MALLOCX_LG_ALIGN_MASK 0x3f
+#define MALLOCX_ZERO 0x40
+#define MALLOCX_TCACHE_NONE 0x100
+#define MALLOCX_SHORT_LIVED 0x10000
+#define MALLOCX_LONG_LIVED 0x20000
+#define MALLOCX_ARENA_SHIFT 20
+
+#define LIFETIME_SHORT 0
+#define LIFETIME_LONG 1
+
+arena *lifetimeArenas[2];
+
+/*
+  lifetimeArena returns the arena of lifetime kind, setting it up on first use, or NULL if MAX_ARENAS arenas exist
+  already. Lifetime arenas do not count against arenaLimit, so the threads keep as many arenas as before.
+*/
+static arena *lifetimeArena(int kind){
+  arena *a;
+  a = __atomic_load_n(&lifetimeArenas[kind], __ATOMIC_ACQUIRE);
+  if(a != NULL){
+    return a;
+  }
+  //The first arena has to be a thread arena
+  currentArena();
+  pthread_mutex_lock(&arenasLock);
+  if(lifetimeArenas[kind] == NULL && arenaCount < MAX_ARENAS){
+    if(arenaLimit < MAX_ARENAS){
+      arenaLimit++;
+    }
+    a = newArena();
+    a->lifetime = 1;
+    __atomic_store_n(&lifetimeArenas[kind], a, __ATOMIC_RELEASE);
+  }
+  a = lifetimeArenas[kind];
+  pthread_mutex_unlock(&arenasLock);
+  return a;
+}
+
+/*
+  flagsArena returns the arena flags select, NULL for the arena of the calling thread, or sets *invalid if they select
+  an arena that does not exist.
+*/
+static arena *flagsArena(int flags, int *invalid){
+  unsigned int index = ((unsigned int) flags) >> MALLOCX_ARENA_SHIFT;
+  *invalid = 0;
+  if(index != 0){
+    if(index > (unsigned int) __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE)){
+      *invalid = 1;
+      return NULL;
+    }
+    return &arenas[index - 1];
+  }
+  if(flags & MALLOCX_LONG_LIVED){
+    return lifetimeArena(LIFETIME_LONG);
+  }
+  if(flags & MALLOCX_SHORT_LIVED){
+    return lifetimeArena(LIFETIME_SHORT);
+  }
+  return NULL;
+}
+
+/*
+  flagsAlign returns the alignment flags ask for, 0 if none.
+*/
+static size_t flagsAlign(int flags){
+  if((flags & MALLOCX_LG_ALIGN_MASK) == 0){
+    return 0;
+  }
+  return (size_t) 1 << (flags & MALLOCX_LG_ALIGN_MASK);
+}
+
+/*
+  If the environment variable MEMORY_LIFETIME is set to yes, allocations are placed by the lifetime their call site is
+  predicted to give them, without the application passing any hint: sites whose blocks mostly live long get them from
+  the long-lived arena of lifetimeArena, the others from the arena of the thread as usual. memory.c passes the return
+  address of malloc and of operator new as the site.
+
+  Sites are learnt by sampling. One allocation in SAMPLE_INTERVAL per thread is recorded in sampledBlocks with its site
+  and the value of lifetimeClock, which counts samples and so advances once every SAMPLE_INTERVAL allocations of the
+  thread that takes them. A sampled block that is freed before LONG_LIVED_TICKS ticks passed has lived short; one that
+  is found older than that when a new sample goes in its bucket, or when it is freed, has lived long, and is only
+  counted once. Each site keeps a count of either kind, halved when it grows beyond SITE_HISTORY so that a site can
+  change its mind, and is predicted long-lived while its long count is the larger one. Sites are found in
+  allocationSites by their hashed address, with a few probes; a site that does not fit is never predicted long-lived.
+  The counts are updated without locks, as an occasional lost update only delays a prediction. sampledBlocks is kept in
+  buckets of SAMPLE_WAYS records by the hashed address of the block, so that free finds a record with a few loads;
+  changing a record takes samplesLock.
+*/
+#define SITE_SLOTS 4096
+#define SITE_PROBES 8
+#define SITE_HISTORY 64
+#define SAMPLE_INTERVAL 64
+#define SAMPLE_BUCKETS 1024
+#define SAMPLE_WAYS 4
+#define LONG_LIVED_TICKS 256
+
+typedef struct allocationSite{
+  void *site;
+  unsigned int shortLived;
+  unsigned int longLived;
+}allocationSite;
+
+typedef struct sampledBlock{
+  void *ptr;
+  allocationSite *site;
+  size_t born;
+  int counted;
+}sampledBlock;
+
+allocationSite allocationSites[SITE_SLOTS];
+sampledBlock sampledBlocks[SAMPLE_BUCKETS][SAMPLE_WAYS];
+size_t lifetimeClock = 0;
+static __thread unsigned int sampleCountdown __attribute__((tls_model("initial-exec"))) = 0;
+
+/*
+  hashPointer scatters the bits of p, most of whose low bits are the same for every block or site.
+*/
+static size_t hashPointer(void *p){
+  size_t h = (size_t) p;
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 32;
+  return h;
+}
+
+/*
+  findSite returns the entry of site in allocationSites, claiming a free one if create is set. Returns NULL if the site
+  has no entry and none could be claimed.
+*/
+static allocationSite *findSite(void *site, int create){
+  allocationSite *entry;
+  void *expected;
+  size_t h, i;
+  h = hashPointer(site);
+  for(i = 0; i < SITE_PROBES; i++){
+    entry = &allocationSites[(h + i) & (SITE_SLOTS - 1)];
+    expected = __atomic_load_n(&entry->site, __ATOMIC_ACQUIRE);
+    if(expected == site){
+      return entry;
+    }
+    if(expected == NULL){
+      if(!create){
+        return NULL;
+      }
+      if(__atomic_compare_exchange_n(&entry->site, &expected, site, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+         expected == site){
+        return entry;
+      }
+    }
+  }
+  return NULL;
+}
+
+/*
+  observeLifetime counts a block of site that lived for age ticks.
+*/
+static void observeLifetime(allocationSite *site, size_t age){
+  unsigned int shortLived, longLived;
+  shortLived = __atomic_load_n(&site->shortLived, __ATOMIC_RELAXED);
+  longLived = __atomic_load_n(&site->longLived, __ATOMIC_RELAXED);
+  if(age >= LONG_LIVED_TICKS){
+    longLived++;
+  }
+  else{
+    shortLived++;
+  }
+  if(shortLived + longLived > SITE_HISTORY){
+    shortLived /= 2;
+    longLived /= 2;
+  }
+  __atomic_store_n(&site->shortLived, shortLived, __ATOMIC_RELAXED);
+  __atomic_store_n(&site->longLived, longLived, __ATOMIC_RELAXED);
+}
+
+/*
+  predictedLongLived tells whether the blocks allocated at site are expected to live long.
+*/
+static int predictedLongLived(void *site){
+  allocationSite *entry = findSite(site, 0);
+  if(entry == NULL){
+    return 0;
+  }
+  return __atomic_load_n(&entry->longLived, __ATOMIC_RELAXED) > __atomic_load_n(&entry->shortLived, __ATOMIC_RELAXED);
+}
+
+/*
+  sampleBlock records ptr, just allocated at site, in sampledBlocks. The blocks of the bucket that have become long-lived
+  are counted, and if the bucket is full, the record of the oldest block is evicted.
+*/
+static void sampleBlock(void *ptr, void *site){
+  allocationSite *entry;
+  sampledBlock *bucket, *slot;
+  size_t now;
+  int i;
+  entry = findSite(site, 1);
+  if(entry == NULL){
+    return;
+  }
+  now = __atomic_add_fetch(&lifetimeClock, 1, __ATOMIC_RELAXED);
+  bucket = sampledBlocks[hashPointer(ptr) & (SAMPLE_BUCKETS - 1)];
+  pthread_mutex_lock(&samplesLock);
+  slot = NULL;
+  for(i = 0; i < SAMPLE_WAYS; i++){
+    if(bucket[i].ptr == NULL){
+      if(slot == NULL || slot->ptr != NULL){
+        slot = &bucket[i];
+      }
+      continue;
+    }
+    if(!bucket[i].counted && now - bucket[i].born >= LONG_LIVED_TICKS){
+      observeLifetime(bucket[i].site, now - bucket[i].born);
+      bucket[i].counted = 1;
+    }
+    if(slot == NULL || (slot->ptr != NULL && bucket[i].born < slot->born)){
+      slot = &bucket[i];
+    }
+  }
+  slot->site = entry;
+  slot->born = now;
+  slot->counted = 0;
+  __atomic_store_n(&slot->ptr, ptr, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&samplesLock);
+}
+
+/*
+  forgetBlock takes the record of ptr, which is being freed, out of sampledBlocks, if there is one, and counts how long
+  the block lived.
+*/
+static void forgetBlock(void *ptr){
+  sampledBlock *bucket;
+  int i;
+  bucket = sampledBlocks[hashPointer(ptr) & (SAMPLE_BUCKETS - 1)];
+  for(i = 0; i < SAMPLE_WAYS; i++){
+    if(__atomic_load_n(&bucket[i].ptr, __ATOMIC_ACQUIRE) == ptr){
+      break;
+    }
+  }
+  if(i == SAMPLE_WAYS){
+    return;
+  }
+  pthread_mutex_lock(&samplesLock);
+  if(bucket[i].ptr == ptr){
+    if(!bucket[i].counted){
+      observeLifetime(bucket[i].site, __atomic_load_n(&lifetimeClock, __ATOMIC_RELAXED) - bucket[i].born);
+    }
+    __atomic_store_n(&bucket[i].ptr, NULL, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&samplesLock);
+}
+
+/*
+  lifetimeFree does the part of __free_impl specific to lifetime prediction for ptr: it forgets the sample of ptr, and
+  frees ptr right away if it belongs to a lifetime arena, so that small long-lived objects do not end up in the thread
+  cache and get reused by unrelated allocations. Returns 1 if ptr was freed.
+*/
+static int lifetimeFree(void *ptr){
+  arena *a;
+  lockWaiter waiter;
+  forgetBlock(ptr);
+  a = ownerOf(ptr);
+  if(!a->lifetime){
+    return 0;
+  }
+  lockArena(a, &waiter);
+  arenaFree(a, ptr);
+  unlockArena(a, &waiter);
+  wakeReclaimer();
+  return 1;
+}
+
+/*
+  Allocation tags attribute memory to the parts of a program. A thread pushes a tag, a number from 1 to ALLOC_TAGS - 1,
+  with __alloc_tag_push_impl and pops it with __alloc_tag_pop_impl; every block it allocates in between is charged to
+  the innermost tag, by its usable size, and credited back to that tag when it is freed, by whichever thread. Tag 0 is no
+  tag and is not counted. Tags pushed more than ALLOC_TAG_DEPTH deep are charged to the tag at that depth.
+
+  The tag of a block is kept with the block: for small objects and runs in allocTags of the run chunk, one byte per
+  ALLOC_TAG_GRANULE bytes, mapped with MAP_NORESERVE by the first tagged allocation in the chunk so that only the parts
+  covering tagged blocks become resident; for free list blocks in the prev field of the node, which arenaMalloc clears.
+  Free reads the tag of a block and clears it again, so that a block that is reused without a tag is not counted.
+
+  Counting is done per thread in tagCounters, without locks or atomic operations, and the counters of every thread are
+  registered in tagThreads. They are only added up when asked for, by __alloc_tag_stats_impl, and when a thread has
+  allocated ALLOC_TAG_CHECK_BYTES under a tag since it last did so. The peak of a tag is the most live bytes seen by one
+  of these checks, which also compare the live bytes against the soft budget of the tag and run its callback once each
+  time the tag goes over it. Exiting threads add their counters to retiredCounters, and threads that find tagThreads
+  full count there directly, with atomic adds and without checks.
+
+  Allocating without a tag costs a load of allocTag and a branch, and so does freeing until a tag is first pushed.
+*/
+#define ALLOC_TAGS 64
+#define ALLOC_TAG_DEPTH 32
+#define ALLOC_TAG_THREADS 256
+#define ALLOC_TAG_CHECK_BYTES ((size_t) 1048576)
+
+typedef struct tagCounter{
+  size_t allocatedBytes;
+  size_t freedBytes;
+  size_t allocations;
+  size_t unchecked;
+}tagCounter;
+
+typedef struct tagTotal{
+  size_t peak;
+  size_t budget;
+  void (*callback)(int, size_t, size_t);
+  int over;
+}tagTotal;
+
+tagCounter *tagThreads[ALLOC_TAG_THREADS];
+tagCounter retiredCounters[ALLOC_TAGS];
+tagTotal tagTotals[ALLOC_TAGS];
+static __thread tagCounter tagCounters[ALLOC_TAGS] __attribute__((tls_model("initial-exec")));
+static __thread unsigned char allocTagStack[ALLOC_TAG_DEPTH] __attribute__((tls_model("initial-exec")));
+static __thread int allocTagDepth __attribute__((tls_model("initial-exec"))) = 0;
+static __thread int allocTag __attribute__((tls_model("initial-exec"))) = 0;
+//The entry of the thread in tagThreads plus one, or -1 if it has none
+static __thread int tagSlot __attribute__((tls_model("initial-exec"))) = 0;
+
+/*
+  threadCounters returns the counters of the calling thread, registering them in tagThreads first if need be, or NULL
+  if the thread has no entry there. The thread is bound to an arena beforehand, so that unbindArena retires its counters
+  when it exits.
+*/
+static tagCounter *threadCounters(){
+  int i;
+  if(tagSlot == 0){
+    currentArena();
+    pthread_mutex_lock(&tagsLock);
+    //Binding the thread may have allocated and registered it already
+    if(tagSlot == 0){
+      for(i = 0; i < ALLOC_TAG_THREADS && tagThreads[i] != NULL; i++);
+      if(i < ALLOC_TAG_THREADS){
+        tagThreads[i] = tagCounters;
+        tagSlot = i + 1;
+      }
+      else{
+        tagSlot = -1;
+      }
+    }
+    pthread_mutex_unlock(&tagsLock);
+  }
+  return tagSlot > 0 ? tagCounters : NULL;
+}
+
+/*
+  addCounter adds the counter from, which may be changed by its thread meanwhile, to sum.
+*/
+static void addCounter(tagCounter *sum, tagCounter *from){
+  sum->allocatedBytes += __atomic_load_n(&from->allocatedBytes, __ATOMIC_RELAXED);
+  sum->freedBytes += __atomic_load_n(&from->freedBytes, __ATOMIC_RELAXED);
+  sum->allocations += __atomic_load_n(&from->allocations, __ATOMIC_RELAXED);
+}
+
+/*
+  retireTagCounters adds the counters of the calling thread, which is exiting, to retiredCounters and gives up its entry
+  in tagThreads. Whatever the thread frees afterwards is counted in retiredCounters.
+*/
+static void retireTagCounters(){
+  int tag;
+  if(tagSlot <= 0){
+    return;
+  }
+  pthread_mutex_lock(&tagsLock);
+  for(tag = 1; tag < ALLOC_TAGS; tag++){
+    addCounter(&retiredCounters[tag], &tagCounters[tag]);
+  }
+  tagThreads[tagSlot - 1] = NULL;
+  tagSlot = -1;
+  pthread_mutex_unlock(&tagsLock);
+}
+
+/*
+  checkTag adds up the counters of tag into *sum, updates the peak of the tag and runs its budget callback if the tag
+  went over its budget since the last check that found it under. Returns the live bytes of the tag.
+*/
+static size_t checkTag(int tag, tagCounter *sum){
+  tagTotal *total = &tagTotals[tag];
+  void (*callback)(int, size_t, size_t) = NULL;
+  size_t live, budget;
+  int i;
+  sum->allocatedBytes = sum->freedBytes = sum->allocations = 0;
+  pthread_mutex_lock(&tagsLock);
+  addCounter(sum, &retiredCounters[tag]);
+  for(i = 0; i < ALLOC_TAG_THREADS; i++){
+    if(tagThreads[i] != NULL){
+      addCounter(sum, &tagThreads[i][tag]);
+    }
+  }
+  //Frees counted by one thread may be read before the allocations counted by another
+  live = sum->allocatedBytes > sum->freedBytes ? sum->allocatedBytes - sum->freedBytes : 0;
+  if(live > total->peak){
+    total->peak = live;
+  }
+  budget = total->budget;
+  if(budget != 0 && live > budget && !total->over){
+    total->over = 1;
+    callback = total->callback;
+  }
+  else if(live <= budget){
+    total->over = 0;
+  }
+  pthread_mutex_unlock(&tagsLock);
+  //The callback may allocate, so it runs without the lock
+  if(callback != NULL){
+    callback(tag, live, budget);
+  }
+  return live;
+}
+
+/*
+  tagOf returns the address of the tag of the block at ptr. If the run chunk of ptr has no tag map yet, one is mapped if
+  create is set, and NULL is returned otherwise or if it could not be mapped.
+*/
+static unsigned char *tagOf(void *ptr, int create){
+  runChunk *chunk;
+  unsigned char *tags;
+  if(chunkKind(ptr) != CHUNK_RUNS){
+    return (unsigned char *) &((node *) (ptr - sizeof(node)))->prev;
+  }
+  chunk = (runChunk *) (((size_t) ptr) & ~(MIN_SIZE - 1));
+  tags = __atomic_load_n(&chunk->allocTags, __ATOMIC_ACQUIRE);
+  if(tags == NULL && create){
+    tags = mmap(NULL, ALLOC_TAG_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(tags == MAP_FAILED){
+      return NULL;
+    }
+    //Several threads may get here at once, only one of them gets to install its map
+    if(!__sync_bool_compare_and_swap(&chunk->allocTags, NULL, tags)){
+      munmap(tags, ALLOC_TAG_MAP_SIZE);
+      tags = __atomic_load_n(&chunk->allocTags, __ATOMIC_ACQUIRE);
+    }
+  }
+  if(tags == NULL){
+    return NULL;
+  }
+  return tags + (ptr - (void *) chunk) / ALLOC_TAG_GRANULE;
+}
+
+/*
+  tagBlock charges ptr, just allocated, to the tag of the calling thread, and checks the tag once the thread allocated
+  ALLOC_TAG_CHECK_BYTES under it. A block whose tag cannot be recorded is not counted. tagBlock and untagBlock are kept
+  out of line so that malloc and free without tags do not grow.
+*/
+static __attribute__((noinline)) void tagBlock(void *ptr){
+  unsigned char *tag;
+  tagCounter *counter, sum;
+  size_t size;
+  tag = tagOf(ptr, 1);
+  if(tag == NULL){
+    return;
+  }
+  *tag = (unsigned char) allocTag;
+  size = usableSize(ptr);
+  counter = threadCounters();
+  if(counter == NULL){
+    __atomic_add_fetch(&retiredCounters[allocTag].allocatedBytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&retiredCounters[allocTag].allocations, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  counter += allocTag;
+  __atomic_store_n(&counter->allocatedBytes, counter->allocatedBytes + size, __ATOMIC_RELAXED);
+  __atomic_store_n(&counter->allocations, counter->allocations + 1, __ATOMIC_RELAXED);
+  counter->unchecked += size;
+  if(counter->unchecked >= ALLOC_TAG_CHECK_BYTES){
+    counter->unchecked = 0;
+    checkTag(allocTag, &sum);
+  }
+}
+
+/*
+  untagBlock credits ptr, which is being freed, back to its tag, if it has one, and clears the tag.
+*/
+static __attribute__((noinline)) void untagBlock(void *ptr){
+  unsigned char *tag;
+  tagCounter *counter;
+  size_t size;
+  int t;
+  tag = tagOf(ptr, 0);
+  if(tag == NULL || *tag == 0){
+    return;
+  }
+  t = *tag;
+  *tag = 0;
+  size = usableSize(ptr);
+  counter = threadCounters();
+  if(counter == NULL){
+    __atomic_add_fetch(&retiredCounters[t].freedBytes, size, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_store_n(&counter[t].freedBytes, counter[t].freedBytes + size, __ATOMIC_RELAXED);
+}
+
+/*
+  An object cache hands out objects of one size whose constructor has already run, and takes them back without running
+  their destructor, so that objects that are expensive to set up, such as ones holding a mutex or an embedded buffer,
+  are only set up once however often they are freed and allocated again. The objects of a cache live in cacheSlabs of
+  slabSize bytes, a power of two of at least CACHE_SLAB_SIZE chosen to hold CACHE_SLAB_OBJECTS objects or more, aligned
+  to slabSize so that the slab of an object is found from its address. Slabs are carved from chunks from createBlock, of
+  which the first also holds the cache itself, and each chunk starts with a regionChunk that links it to the chunk
+  before it, as for regions. The constructor runs on every object of a slab when the slab is freshly carved, and the
+  destructor only when a slab is given up by __cache_reap_impl or the cache is destroyed.
+
+  The free objects of a slab are linked through a word placed right after each object, never through the object itself,
+  which would undo its construction. Slabs with free objects are on partial, slabs with none on full, and slabs whose
+  objects are all free on empty, where they stay constructed until they are reaped. A reaped slab has its pages given
+  back with madvise and goes on unused, from which it is carved again before any new memory is. Every cache has its own
+  lock, which is never held while a constructor or destructor runs or while memory is mapped. Live caches are kept on
+  caches, under cachesLock, so that the fork handlers can take their locks.
+*/
+#define CACHE_ALIGN ((size_t) 16)
+#define CACHE_SLAB_SIZE ((size_t) 65536)
+#define CACHE_SLAB_OBJECTS 8
+#define CACHE_MAX_SLAB (MIN_SIZE / 16)
+
+typedef struct cacheSlab{
+  struct cacheSlab *next;
+  struct cacheSlab *prev;
+  void *free;
+  size_t used;
+}cacheSlab;
+
+typedef struct objectCache{
+  allocLock lock;
+  size_t size;
+  size_t stride;
+  size_t first;
+  size_t perSlab;
+  size_t slabSize;
+  void (*ctor)(void *);
+  void (*dtor)(void *);
+  cacheSlab *partial;
+  cacheSlab *full;
+  cacheSlab *empty;
+  cacheSlab *unused;
+  regionChunk *chunks;
+  void *carve;
+  void *end;
+  struct objectCache *next;
+  struct objectCache *prev;
+  lockWaiter forkWaiter;
+}objectCache;
+
+objectCache *caches = NULL;
+pthread_mutex_t cachesLock = PTHREAD_MUTEX_INITIALIZER;
+
+//The link of a free object is the word after it
+#define CACHE_LINK(c, obj) (*((void **) ((obj) + (((c)->size + sizeof(void *) - 1) & ~(sizeof(void *) - 1)))))
+
+/*
+  pushCacheSlab puts slab at the front of the slab list *list.
+*/
+static void pushCacheSlab(cacheSlab **list, cacheSlab *slab){
+  slab->prev = NULL;
+  slab->next = *list;
+  if(*list != NULL){
+    (*list)->prev = slab;
+  }
+  *list = slab;
+}
+
+/*
+  unlinkCacheSlab takes slab off the slab list *list.
+*/
+static void unlinkCacheSlab(cacheSlab **list, cacheSlab *slab){
+  if(slab->prev != NULL){
+    slab->prev->next = slab->next;
+  }
+  else{
+    *list = slab->next;
+  }
+  if(slab->next != NULL){
+    slab->next->prev = slab->prev;
+  }
+}
+
+/*
+  takeSlab returns a slab of cache c whose objects are not constructed: a reaped one from unused, or one carved from the
+  current chunk of c, a new chunk being mapped when that is used up. c is locked on entry and on return, but not while
+  mapping. Returns NULL if no memory could be mapped.
+*/
+static cacheSlab *takeSlab(objectCache *c, lockWaiter *waiter){
+  cacheSlab *slab;
+  regionChunk *chunk;
+  size_t mapped;
+  void *start;
+  while(1){
+    if(c->unused != NULL){
+      slab = c->unused;
+      c->unused = slab->next;
+      return slab;
+    }
+    start = (void *) ((((size_t) c->carve) + c->slabSize - 1) & ~(c->slabSize - 1));
+    if(start + c->slabSize <= c->end){
+      c->carve = start + c->slabSize;
+      return start;
+    }
+    releaseLock(&c->lock, waiter);
+    //A chunk large enough for one slab whatever its alignment
+    chunk = createBlock(c->slabSize * 2, NULL, &mapped);
+    acquireLock(&c->lock, waiter);
+    if(chunk == NULL){
+      return NULL;
+    }
+    chunk->prev = c->chunks;
+    chunk->size = mapped;
+    c->chunks = chunk;
+    c->carve = ((void *) chunk) + sizeof(regionChunk);
+    c->end = ((void *) chunk) + mapped;
+  }
+}
+
+/*
+  constructSlab runs the constructor of cache c on every object of slab, which is fresh, and links them all up as free.
+*/
+static void constructSlab(objectCache *c, cacheSlab *slab){
+  void *obj;
+  size_t i;
+  slab->free = NULL;
+  slab->used = 0;
+  //Link from the last object back so that objects are handed out in address order
+  for(i = c->perSlab; i > 0; i--){
+    obj = ((void *) slab) + c->first + (i - 1) * c->stride;
+    if(c->ctor != NULL){
+      c->ctor(obj);
+    }
+    CACHE_LINK(c, obj) = slab->free;
+    slab->free = obj;
+  }
+}
+
+/*
+  destructFree runs the destructor of cache c on every free object of slab.
+*/
+static void destructFree(objectCache *c, cacheSlab *slab){
+  void *obj;
+  if(c->dtor == NULL){
+    return;
+  }
+  for(obj = slab->free; obj != NULL; obj = CACHE_LINK(c, obj)){
+    c->dtor(obj);
+  }
+}
+/* End of your helper functions */
+
+/* Start of the actual malloc/calloc/realloc/free functions */
+
+void __free_impl(void *);
+
+/*
+  __malloc_impl is an implementation of the malloc system call and functions in the same fashion. It accepts 
+  a size in bytes and returns a pointer to a free memory block of the requested size, taken by arenaMalloc from the
+  arena the calling thread is bound to, or for small requests by cacheAlloc from the thread cache. If the arena is out
+  of memory, it is refilled by refillArena. A thread that had to wait for the lock of its arena moves on to another
+  arena afterwards, see leaveArena.
+
+*/
+void *__malloc_impl(size_t size) {
+  arena *a;
+  void *ptr;
+  int contended;
+  lockWaiter waiter;
+  void *hint;
+  //Small requests are served from the thread cache when possible
+  if(size != 0 && size <= SLAB_MAX_SIZE){
+    ptr = cacheAlloc(size);
+    if(ptr != NULL){
+      if(allocTag != 0){
+        tagBlock(ptr);
+      }
+      return ptr;
+    }
+  }
+  a = currentArena();
+  contended = lockArena(a, &waiter);
+  ptr = arenaMalloc(a, size);
+  hint = a->topEnd;
+  unlockArena(a, &waiter);
+  //Map more memory outside of the lock until the request can be served
+  while(ptr == NULL && size != 0 && refillArena(a, size, hint) == 0){
+    lockArena(a, &waiter);
+    ptr = arenaMalloc(a, size);
+    hint = a->topEnd;
+    unlockArena(a, &waiter);
+  }
+  wakeReclaimer();
+  if(contended){
+    leaveArena();
+  }
+  if(ptr != NULL && allocTag != 0){
+    tagBlock(ptr);
+  }
+  return ptr;
+}
+
+/*
+
+  __calloc_impl is an implemenation of the calloc system call. Memory is manually allocated and then set to 0. 
+  It accepts two sizes in bytes, one for the size of the members and the total size. Multiplication of these two sizes is 
+  implemented using the provided _try_size_t_multiply function. Once the total size is found, __calloc_impl calls __malloc_impl 
+  to create the block. Each member is set to '0' using the provided __memset function 
+
+*/
+
+void *__calloc_impl(size_t nmemb, size_t size) {
+  size_t sizeRequired;
+  void *ptr;
+  int multiplySuccess;
+  //Use provided mutiply function to multiply nmeb and size, returns 1 on success, 0 on failure
+  multiplySuccess = __try_size_t_multiply(&sizeRequired, nmemb, size);
+  if(multiplySuccess){
+  //Use new implementation of malloc
+    ptr = __malloc_impl(sizeRequired);
+    if(ptr != NULL){
+      //Use provided memset function to set all to 0
+      __memset(ptr, 0, sizeRequired);
+    }
+    return ptr;
+  }
+  else{
+    //Return null in case of any errors
+    return NULL;
+  }
+}
+
+/*
+  __realloc_impl is an implemenation of system call realloc. It takes a previously allocated node and a new size
+  and adjusts the size of the node. If the pointer is null, __realloc_impl calls __malloc_impl and returns the allocated
+  space. If size is 0, __realloc_impl calls __free_impl to free the node. If the new size is smaller than that of the 
+  existing node, only the memory up until new size is copied. Other size it copies all of the space up until the size of 
+  the existing node and leaves the remainder unpopulated. Memory copies are done using the provided __memcopy function.
+  If the existing node already has the rounded size of the new size, see roundedSize, it is returned unchanged.
+
+*/
+
+void *__realloc_impl(void *ptr, size_t size) {
+  void *newptr;
+  size_t oldSize;
+  //If size is 0, realloc function as free, call free on ptr
+  if(size == (size_t) 0){
+   __free_impl(ptr);
+   return NULL;
+  }
+  //A block that already has the size a new one would get is kept as it is
+  if(ptr != NULL && roundedSize(size) == usableSize(ptr)){
+    return ptr;
+  }
+  newptr = __malloc_impl(size);
+  //If ptr is null, realloc functions as malloc 
+  if((ptr) == NULL){
+    return newptr;
+  }  
+  //On failure the old block is left untouched
+  if(newptr == NULL){
+    return NULL;
+  }
+  //Small and medium blocks have no header, usableSize finds the size in whichever tier the block is in
+  oldSize = usableSize(ptr);
+
+  /*Copy the full size of the old block if it is smaller than the size value passed,
+    otherwise use the argument.*/
+  if (oldSize < size) {
+    //Use provided __memcpy function to copy memory from old to new memory blocks
+    __memcpy(newptr, ptr, oldSize);
+  }
+  else {
+	__memcpy(newptr, ptr, size);
+  }
+  //Free old pointer and return new pointer
+  __free_impl(ptr);
+  return newptr;
+}
+
+/*
+  __free_impl is an implemenation of the system call free. It takes a void pointer to previously allocated memory 
+  and adds it to the list of free memory nodes. This is done by retrieving the information about the node in the
+  header that was populated when the node was allocated. NOTE* if free is called on a pointer that was not allocated, 
+  casting to a node* to retrieve node information will result in a segmentation fault. A check is made if the number
+  of allocations is equal to the number of freed nodes, and if so, __free_impl calls unmapBlocks to release the memory. 
+
+*/
+ void __free_impl(void *ptr){
+   arena *a;
+   lockWaiter waiter;
+   //Handle case free(nil)
+   if(ptr == NULL){
+     return;
+   }
+   if(tagsInUse){
+     untagBlock(ptr);
+   }
+   if(lifetimePrediction && lifetimeFree(ptr)){
+     return;
+   }
+   //Small objects go to the thread cache
+   if(chunkKind(ptr) == CHUNK_RUNS && isSlabObject(ptr)){
+     cacheFree(ptr, slabOf(ptr)->sizeClass);
+     return;
+   }
+   a = ownerOf(ptr);
+   lockArena(a, &waiter);
+   arenaFree(a, ptr);
+   unlockArena(a, &waiter);
+   //Memory the free made redundant is unmapped by the reclaimer, not here
+   wakeReclaimer();
+}
+
+/*
+  __free_deferred_impl frees ptr like __free_impl, except that blocks other than small objects are only queued and
+  freed later by the reclaimer thread, so the caller does not wait for the arena lock or for coalescing. The caller
+  frees the queue itself if more than DEFERRED_MAX_BYTES are waiting in it.
+*/
+void __free_deferred_impl(void *ptr){
+  void *head;
+  size_t size, waiting;
+  if(ptr == NULL){
+    return;
+  }
+  if(tagsInUse){
+    untagBlock(ptr);
+  }
+  if(lifetimePrediction){
+    forgetBlock(ptr);
+  }
+  if(chunkKind(ptr) == CHUNK_RUNS && isSlabObject(ptr)){
+    cacheFree(ptr, slabOf(ptr)->sizeClass);
+    return;
+  }
+  //Count the block before it can be taken off the queue, so that deferredBytes never drops below zero
+  size = usableSize(ptr);
+  waiting = __atomic_add_fetch(&deferredBytes, size, __ATOMIC_RELAXED);
+  head = __atomic_load_n(&deferredQueue, __ATOMIC_RELAXED);
+  do{
+    *((void **) ptr) = head;
+  }while(!__atomic_compare_exchange_n(&deferredQueue, &head, ptr, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  if(waiting > DEFERRED_MAX_BYTES){
+    drainDeferred();
+    wakeReclaimer();
+  }
+  else if(waiting >= DEFERRED_WAKE_BYTES && waiting - size < DEFERRED_WAKE_BYTES){
+    wakeReclaimer();
+  }
+}
+
+/*
+  __heap_create_impl creates a private heap and returns a handle for it, or NULL if it could not be mapped.
+*/
+void *__heap_create_impl(void){
+  arena *h;
+  h = mmap(NULL, HEAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(h == MAP_FAILED){
+    return NULL;
+  }
+  //The mapping is zero, which is an empty arena with a free lock
+  h->privateHeap = 1;
+  return h;
+}
+
+/*
+  __heap_malloc_impl allocates size bytes from the private heap h, like __malloc_impl but without any locking.
+*/
+void *__heap_malloc_impl(void *h, size_t size){
+  void *ptr;
+  ptr = arenaMalloc(h, size);
+  while(ptr == NULL && size != 0 && heapRefill(h, size) == 0){
+    ptr = arenaMalloc(h, size);
+  }
+  wakeReclaimer();
+  return ptr;
+}
+
+/*
+  __heap_free_impl frees ptr, which must have been allocated from the private heap h.
+*/
+void __heap_free_impl(void *h, void *ptr){
+  if(ptr == NULL){
+    return;
+  }
+  arenaFree(h, ptr);
+  wakeReclaimer();
+}
+
+/*
+  __heap_destroy_impl releases the private heap h along with every block still allocated from it: its run chunks, its
+  wilderness mappings, its free table if it has one and the heap itself.
+*/
+void __heap_destroy_impl(void *h){
+  arena *a = h;
+  releaseRecord *record, *next;
+  if(a == NULL){
+    return;
+  }
+  unmapRunChunks(a);
+  for(record = a->mappings; record != NULL; record = next){
+    next = record->next;
+    queueRelease(record, record->size);
+  }
+#ifdef FREE_TABLE
+  if(a->freeTable != NULL){
+    queueRelease(a->freeTable, a->freeCapacity * (sizeof(freeEntry) + sizeof(unsigned int)));
+  }
+#endif
+  queueRelease(a, HEAP_SIZE);
+  wakeReclaimer();
+}
+
+/*
+  __region_create_impl creates a region and returns a handle for it, or NULL if its first chunk could not be mapped.
+*/
+void *__region_create_impl(void){
+  regionChunk *chunk;
+  region *r;
+  size_t mapped;
+  chunk = createBlock(MIN_SIZE, NULL, &mapped);
+  if(chunk == NULL){
+    return NULL;
+  }
+  chunk->prev = NULL;
+  chunk->size = mapped;
+  r = (region *) (((void *) chunk) + sizeof(regionChunk));
+  r->chunk = chunk;
+  r->next = ((void *) chunk) + REGION_START;
+  r->end = ((void *) chunk) + mapped;
+  r->spare = NULL;
+  return r;
+}
+
+/*
+  __region_alloc_impl returns size bytes, aligned to REGION_ALIGN, from the region handle. Returns NULL if size is 0 or
+  no memory could be mapped.
+*/
+void *__region_alloc_impl(void *handle, size_t size){
+  region *r = handle;
+  void *ptr;
+  if(size == 0 || size + REGION_ALIGN - 1 < size){
+    return NULL;
+  }
+  size = (size + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1);
+  if((size_t) (r->end - r->next) < size && regionGrow(r, size) < 0){
+    return NULL;
+  }
+  ptr = r->next;
+  r->next += size;
+  return ptr;
+}
+
+/*
+  __region_mark_impl returns the current position of the region handle, to be handed to __region_release_impl.
+*/
+void *__region_mark_impl(void *handle){
+  return ((region *) handle)->next;
+}
+
+/*
+  __region_release_impl frees everything allocated from the region handle since mark was taken. Chunks started after
+  the mark are given up; mark lies within the chunk that was current when it was taken, which becomes current again.
+*/
+void __region_release_impl(void *handle, void *mark){
+  region *r = handle;
+  while(!(mark > (void *) r->chunk && mark <= (void *) r->chunk + r->chunk->size)){
+    regionDrop(r);
+  }
+  r->next = mark;
+  wakeReclaimer();
+}
+
+/*
+  __region_reset_impl frees everything allocated from the region handle, keeping its first chunk.
+*/
+void __region_reset_impl(void *handle){
+  region *r = handle;
+  while(r->chunk->prev != NULL){
+    regionDrop(r);
+  }
+  r->next = ((void *) r->chunk) + REGION_START;
+  wakeReclaimer();
+}
+
+/*
+  __region_destroy_impl frees the region handle along with all memory allocated from it.
+*/
+void __region_destroy_impl(void *handle){
+  region *r = handle;
+  regionChunk *chunk, *prev;
+  if(r->spare != NULL){
+    queueRelease(r->spare, r->spare->size);
+  }
+  for(chunk = r->chunk; chunk != NULL; chunk = prev){
+    prev = chunk->prev;
+    queueRelease(chunk, chunk->size);
+  }
+  wakeReclaimer();
+}
+
+/*
+  __malloc_batch_impl allocates count blocks of size bytes into out, under one lock of the arena of the calling thread,
+  and returns the number of blocks allocated. That is less than count only if memory ran out, in which case the blocks
+  that were allocated are still in out and must be freed by the caller.
+*/
+size_t __malloc_batch_impl(size_t size, size_t count, void **out){
+  arena *a;
+  lockWaiter waiter;
+  size_t got = 0, refill, i;
+  void *hint;
+  int contended;
+  if(size == 0){
+    return 0;
+  }
+  a = currentArena();
+  contended = lockArena(a, &waiter);
+  while(got < count){
+    out[got] = arenaMalloc(a, size);
+    if(out[got] != NULL){
+      got++;
+      continue;
+    }
+    hint = a->topEnd;
+    unlockArena(a, &waiter);
+    //Map room for the rest of the batch at once, and fall back to room for one block if that fails
+    refill = batchRefillSize(size, count - got);
+    if(refillArena(a, refill, hint) != 0 && (refill == size || refillArena(a, size, hint) != 0)){
+      break;
+    }
+    lockArena(a, &waiter);
+  }
+  if(got == count){
+    unlockArena(a, &waiter);
+  }
+  wakeReclaimer();
+  if(contended){
+    leaveArena();
+  }
+  if(allocTag != 0){
+    for(i = 0; i < got; i++){
+      tagBlock(out[i]);
+    }
+  }
+  return got;
+}
+
+/*
+  __free_batch_impl frees the count blocks in ptrs, which may contain NULL. ptrs is sorted and overwritten: its contents
+  are undefined afterwards. Each run of blocks that belong to the same arena is freed under one lock of the arena.
+*/
+void __free_batch_impl(void **ptrs, size_t count){
+  arena *a;
+  lockWaiter waiter = {0};
+  size_t first, end;
+  if(lifetimePrediction || tagsInUse){
+    for(first = 0; first < count; first++){
+      if(ptrs[first] != NULL && tagsInUse){
+        untagBlock(ptrs[first]);
+      }
+      if(ptrs[first] != NULL && lifetimePrediction){
+        forgetBlock(ptrs[first]);
+      }
+    }
+  }
+  sortPointers(ptrs, count);
+  //NULL sorts first
+  for(first = 0; first < count && ptrs[first] == NULL; first++);
+  while(first < count){
+    a = ownerOf(ptrs[first]);
+    for(end = first + 1; end < count && ownerOf(ptrs[end]) == a; end++);
+    lockArena(a, &waiter);
+    arenaFreeSorted(a, ptrs + first, end - first);
+    unlockArena(a, &waiter);
+    first = end;
+  }
+  wakeReclaimer();
+}
+
+/*
+  __memalign_impl returns a block of size bytes aligned to align, which must be a power of two. Returns NULL if align is
+  not, if size is 0 or if no memory could be had.
+*/
+void *__memalign_impl(size_t align, size_t size){
+  void *ptr;
+  int contended;
+  if(align == 0 || (align & (align - 1)) != 0 || size == 0){
+    return NULL;
+  }
+  //Every block is aligned to 16 bytes, and small aligned requests take a class, both through the thread cache
+  if(align <= 16){
+    return __malloc_impl(size);
+  }
+  if(alignedInClass(size, align)){
+    return __malloc_impl(classSizes[alignedClassOf(size, align)]);
+  }
+  ptr = mallocIn(currentArena(), size, align, &contended);
+  if(contended){
+    leaveArena();
+  }
+  if(ptr != NULL && allocTag != 0){
+    tagBlock(ptr);
+  }
+  return ptr;
+}
+
+/*
+  __malloc_usable_size_impl returns the number of bytes the block at ptr can hold, which may be more than was asked for,
+  or 0 if ptr is NULL.
+*/
+size_t __malloc_usable_size_impl(void *ptr){
+  if(ptr == NULL){
+    return 0;
+  }
+  return usableSize(ptr);
+}
+
+/*
+  __nallocx_impl returns the number of bytes a block from __mallocx_impl for a request of size bytes with flags can hold,
+  without allocating anything, or 0 if size is 0 or too large.
+*/
+size_t __nallocx_impl(size_t size, int flags){
+  return roundedAlignedSize(size, flagsAlign(flags));
+}
+
+/*
+  __free_sized_impl frees ptr like __free_impl, size being the size it was allocated with. Small objects are put in the
+  thread cache of the class size maps to, without reading the slab header; other blocks need their header or their run
+  chunk anyway and go through __free_impl. So do all blocks with MEMORY_LIFETIME, as their samples have to be
+  forgotten, see lifetimeFree, and once allocation tags are in use, see untagBlock. A small size does not make a small
+  object: a free list block, such as one from __memalign_impl, that __realloc_impl kept for a small size has one too.
+  Such a block is not in a run chunk, which chunkKinds tells with a single load. Run blocks are never that small.
+*/
+void __free_sized_impl(void *ptr, size_t size){
+  if(ptr != NULL && size != 0 && size <= SLAB_MAX_SIZE && !lifetimePrediction && !tagsInUse &&
+     chunkKind(ptr) == CHUNK_RUNS){
+    cacheFree(ptr, sizeClassOf(size));
+    return;
+  }
+  __free_impl(ptr);
+}
+
+/*
+  __free_aligned_sized_impl frees ptr like __free_impl, ptr having been allocated by __memalign_impl with align and size.
+  Small objects are put in the thread cache of the class __memalign_impl took them from, once chunkKinds shows that ptr
+  is one, see __free_sized_impl.
+*/
+void __free_aligned_sized_impl(void *ptr, size_t align, size_t size){
+  if(align <= 16){
+    __free_sized_impl(ptr, size);
+    return;
+  }
+  if(ptr != NULL && size != 0 && size <= SLAB_MAX_SIZE && align <= SLAB_HEADER_SIZE && !lifetimePrediction &&
+     !tagsInUse && chunkKind(ptr) == CHUNK_RUNS){
+    cacheFree(ptr, alignedClassOf(size, align));
+    return;
+  }
+  __free_impl(ptr);
+}
+
+/*
+  __mallocx_impl returns a block of size bytes as asked for by flags, see MALLOCX_ZERO and the others. Returns NULL if
+  size is 0, if flags select an arena that does not exist or if no memory could be had.
+*/
+void *__mallocx_impl(size_t size, int flags){
+  arena *a;
+  void *ptr;
+  size_t align;
+  int invalid, contended;
+  if(size == 0){
+    return NULL;
+  }
+  align = flagsAlign(flags);
+  a = flagsArena(flags, &invalid);
+  if(invalid){
+    return NULL;
+  }
+  if(a == NULL && !(flags & MALLOCX_TCACHE_NONE)){
+    ptr = align == 0 ? __malloc_impl(size) : __memalign_impl(align, size);
+  }
+  else if(a == NULL){
+    ptr = mallocIn(currentArena(), size, align, &contended);
+    if(contended){
+      leaveArena();
+    }
+  }
+  else{
+    ptr = mallocIn(a, size, align, &contended);
+  }
+  //Blocks from __malloc_impl and __memalign_impl have been tagged already
+  if(ptr != NULL && allocTag != 0 && (a != NULL || (flags & MALLOCX_TCACHE_NONE))){
+    tagBlock(ptr);
+  }
+  if(ptr != NULL && (flags & MALLOCX_ZERO)){
+    __memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+/*
+  __dallocx_impl frees ptr, allocated by __mallocx_impl. With flags that bypass the thread cache or select an arena,
+  small objects go straight back to their arena as well.
+*/
+void __dallocx_impl(void *ptr, int flags){
+  arena *a;
+  lockWaiter waiter;
+  if(ptr == NULL){
+    return;
+  }
+  if(lifetimePrediction){
+    forgetBlock(ptr);
+  }
+  if(!(flags & (MALLOCX_TCACHE_NONE | MALLOCX_SHORT_LIVED | MALLOCX_LONG_LIVED)) && (((unsigned int) flags) >> MALLOCX_ARENA_SHIFT) == 0){
+    __free_impl(ptr);
+    return;
+  }
+  if(tagsInUse){
+    untagBlock(ptr);
+  }
+  a = ownerOf(ptr);
+  lockArena(a, &waiter);
+  arenaFree(a, ptr);
+  unlockArena(a, &waiter);
+  wakeReclaimer();
+}
+
+/*
+  __rallocx_impl resizes ptr, allocated by __mallocx_impl, to size bytes as asked for by flags, like __realloc_impl.
+  With MALLOCX_ZERO, the bytes beyond the old size are zeroed. Returns NULL if size is 0 or the block could not be
+  resized, in which case ptr is left untouched.
+*/
+void *__rallocx_impl(void *ptr, size_t size, int flags){
+  arena *a;
+  void *newptr;
+  size_t oldSize, align;
+  int invalid;
+  if(ptr == NULL){
+    return __mallocx_impl(size, flags);
+  }
+  a = flagsArena(flags, &invalid);
+  if(size == 0 || invalid){
+    return NULL;
+  }
+  oldSize = usableSize(ptr);
+  align = flagsAlign(flags);
+  //A block that already has the size and alignment a new one would get is kept, if it is in the arena flags select
+  if(roundedAlignedSize(size, align) == oldSize && (align == 0 || (((size_t) ptr) & (align - 1)) == 0) &&
+     (a == NULL || ownerOf(ptr) == a)){
+    return ptr;
+  }
+  newptr = __mallocx_impl(size, flags & ~MALLOCX_ZERO);
+  if(newptr == NULL){
+    return NULL;
+  }
+  __memcpy(newptr, ptr, oldSize < size ? oldSize : size);
+  if((flags & MALLOCX_ZERO) && size > oldSize){
+    __memset(newptr + oldSize, 0, size - oldSize);
+  }
+  __dallocx_impl(ptr, flags);
+  return newptr;
+}
+
+/*
+  __malloc_site_impl is __malloc_impl for a request made at the return address site. With MEMORY_LIFETIME, blocks for
+  sites predicted to be long-lived come from the long-lived arena, and one request in SAMPLE_INTERVAL is sampled.
+*/
+void *__malloc_site_impl(size_t size, void *site){
+  arena *a = NULL;
+  void *ptr;
+  int contended, sampled;
+  if(!lifetimePrediction || size == 0){
+    return __malloc_impl(size);
+  }
+  sampled = sampleCountdown == 0;
+  sampleCountdown = sampled ? SAMPLE_INTERVAL - 1 : sampleCountdown - 1;
+  if(predictedLongLived(site)){
+    a = lifetimeArena(LIFETIME_LONG);
+  }
+  if(a != NULL){
+    ptr = mallocIn(a, size, 0, &contended);
+    if(ptr != NULL && allocTag != 0){
+      tagBlock(ptr);
+    }
+  }
+  else{
+    ptr = __malloc_impl(size);
+  }
+  if(ptr != NULL && sampled){
+    sampleBlock(ptr, site);
+  }
+  return ptr;
+}
+
+/*
+  __alloc_tag_push_impl charges the allocations of the calling thread to tag until the matching __alloc_tag_pop_impl.
+  A tag out of range is pushed as no tag, so that pushes and pops still pair up.
+*/
+void __alloc_tag_push_impl(int tag){
+  if(tag < 0 || tag >= ALLOC_TAGS){
+    tag = 0;
+  }
+  if(!tagsInUse){
+    __atomic_store_n(&tagsInUse, 1, __ATOMIC_RELEASE);
+  }
+  if(allocTagDepth < ALLOC_TAG_DEPTH){
+    allocTagStack[allocTagDepth] = (unsigned char) tag;
+    allocTag = tag;
+  }
+  allocTagDepth++;
+}
+
+/*
+  __alloc_tag_pop_impl goes back to the tag that was pushed before the last one, or to no tag. Popping more tags than
+  were pushed does nothing.
+*/
+void __alloc_tag_pop_impl(void){
+  if(allocTagDepth == 0){
+    return;
+  }
+  allocTagDepth--;
+  if(allocTagDepth < ALLOC_TAG_DEPTH){
+    allocTag = allocTagDepth == 0 ? 0 : allocTagStack[allocTagDepth - 1];
+  }
+}
+
+/*
+  __alloc_tag_stats_impl adds up the counters of tag and stores its live bytes, its peak, the bytes allocated under it
+  and the number of allocations under it in whichever of the pointers are not NULL. Dividing the latter two by the time
+  between two calls gives the allocation rate of the tag. Returns 0, or -1 if tag is out of range.
+*/
+int __alloc_tag_stats_impl(int tag, size_t *liveBytes, size_t *peakBytes, size_t *allocatedBytes, size_t *allocations){
+  tagCounter sum;
+  size_t live;
+  if(tag <= 0 || tag >= ALLOC_TAGS){
+    return -1;
+  }
+  live = checkTag(tag, &sum);
+  if(liveBytes != NULL){
+    *liveBytes = live;
+  }
+  if(peakBytes != NULL){
+    *peakBytes = __atomic_load_n(&tagTotals[tag].peak, __ATOMIC_RELAXED);
+  }
+  if(allocatedBytes != NULL){
+    *allocatedBytes = sum.allocatedBytes;
+  }
+  if(allocations != NULL){
+    *allocations = sum.allocations;
+  }
+  return 0;
+}
+
+/*
+  __alloc_tag_budget_impl sets the soft budget of tag to budget live bytes, 0 meaning none. callback, if not NULL, is
+  called with the tag, its live bytes and the budget by the thread whose check finds the tag over budget, once until a
+  check finds it under again; the allocation that led to the check has been made. Returns 0, or -1 if tag is out of
+  range.
+*/
+int __alloc_tag_budget_impl(int tag, size_t budget, void (*callback)(int, size_t, size_t)){
+  if(tag <= 0 || tag >= ALLOC_TAGS){
+    return -1;
+  }
+  pthread_mutex_lock(&tagsLock);
+  tagTotals[tag].budget = budget;
+  tagTotals[tag].callback = callback;
+  tagTotals[tag].over = 0;
+  pthread_mutex_unlock(&tagsLock);
+  return 0;
+}
+
+/*
+  lockCaches takes cachesLock and the lock of every live cache before a fork, unlockCaches gives them back in the parent
+  and resetCaches sets them up anew in the child.
+*/
+static void lockCaches(){
+  objectCache *c;
+  pthread_mutex_lock(&cachesLock);
+  for(c = caches; c != NULL; c = c->next){
+    acquireLock(&c->lock, &c->forkWaiter);
+  }
+}
+
+static void unlockCaches(){
+  objectCache *c;
+  for(c = caches; c != NULL; c = c->next){
+    releaseLock(&c->lock, &c->forkWaiter);
+  }
+  pthread_mutex_unlock(&cachesLock);
+}
+
+static void resetCaches(){
+  objectCache *c;
+  for(c = caches; c != NULL; c = c->next){
+    initLock(&c->lock);
+  }
+  pthread_mutex_init(&cachesLock, NULL);
+}
+
+/*
+  __cache_create_impl creates an object cache for objects of size bytes aligned to align, a power of two of at most
+  PAGE_SIZE or 0 for the default of CACHE_ALIGN, and returns a handle for it. ctor and dtor may be NULL. Returns NULL if
+  size is 0, the objects are too large for a slab of CACHE_MAX_SLAB bytes, align is not valid or no memory could be
+  mapped.
+*/
+void *__cache_create_impl(size_t size, size_t align, void (*ctor)(void *), void (*dtor)(void *)){
+  regionChunk *chunk;
+  objectCache *c;
+  size_t mapped, stride, first, slabSize;
+  if(align == 0){
+    align = CACHE_ALIGN;
+  }
+  if(size == 0 || size > CACHE_MAX_SLAB || (align & (align - 1)) != 0 || align > PAGE_SIZE){
+    return NULL;
+  }
+  if(align < sizeof(void *)){
+    align = sizeof(void *);
+  }
+  stride = (((size + sizeof(void *) - 1) & ~(sizeof(void *) - 1)) + sizeof(void *) + align - 1) & ~(align - 1);
+  first = (sizeof(cacheSlab) + align - 1) & ~(align - 1);
+  for(slabSize = CACHE_SLAB_SIZE; (slabSize - first) / stride < CACHE_SLAB_OBJECTS; slabSize *= 2){
+    if(slabSize >= CACHE_MAX_SLAB){
+      return NULL;
+    }
+  }
+  chunk = createBlock(MIN_SIZE, NULL, &mapped);
+  if(chunk == NULL){
+    return NULL;
+  }
+  chunk->prev = NULL;
+  chunk->size = mapped;
+  //The mapping is zero, so every list of the cache is empty
+  c = (objectCache *) (((void *) chunk) + sizeof(regionChunk));
+  initLock(&c->lock);
+  c->size = size;
+  c->stride = stride;
+  c->first = first;
+  c->perSlab = (slabSize - first) / stride;
+  c->slabSize = slabSize;
+  c->ctor = ctor;
+  c->dtor = dtor;
+  c->chunks = chunk;
+  c->carve = ((void *) c) + sizeof(objectCache);
+  c->end = ((void *) chunk) + mapped;
+  pthread_mutex_lock(&cachesLock);
+  c->next = caches;
+  if(caches != NULL){
+    caches->prev = c;
+  }
+  caches = c;
+  pthread_mutex_unlock(&cachesLock);
+  return c;
+}
+
+/*
+  __cache_alloc_impl returns a constructed object from the cache handle, taking it from a partly used slab, then from an
+  empty one, and only then from a fresh slab, whose objects are constructed first. Returns NULL if no memory could be
+  mapped.
+*/
+void *__cache_alloc_impl(void *handle){
+  objectCache *c = handle;
+  cacheSlab *slab;
+  lockWaiter waiter;
+  void *obj;
+  acquireLock(&c->lock, &waiter);
+  while(c->partial == NULL){
+    if(c->empty != NULL){
+      slab = c->empty;
+      unlinkCacheSlab(&c->empty, slab);
+      pushCacheSlab(&c->partial, slab);
+      break;
+    }
+    slab = takeSlab(c, &waiter);
+    if(slab == NULL){
+      releaseLock(&c->lock, &waiter);
+      return NULL;
+    }
+    releaseLock(&c->lock, &waiter);
+    constructSlab(c, slab);
+    acquireLock(&c->lock, &waiter);
+    pushCacheSlab(&c->partial, slab);
+  }
+  slab = c->partial;
+  obj = slab->free;
+  slab->free = CACHE_LINK(c, obj);
+  slab->used++;
+  if(slab->used == c->perSlab){
+    unlinkCacheSlab(&c->partial, slab);
+    pushCacheSlab(&c->full, slab);
+  }
+  releaseLock(&c->lock, &waiter);
+  return obj;
+}
+
+/*
+  __cache_free_impl gives obj, allocated from the cache handle and in the state its constructor left it in, back to its
+  slab without destructing it.
+*/
+void __cache_free_impl(void *handle, void *obj){
+  objectCache *c = handle;
+  cacheSlab *slab;
+  lockWaiter waiter;
+  if(obj == NULL){
+    return;
+  }
+  slab = (cacheSlab *) (((size_t) obj) & ~(c->slabSize - 1));
+  acquireLock(&c->lock, &waiter);
+  CACHE_LINK(c, obj) = slab->free;
+  slab->free = obj;
+  if(slab->used == c->perSlab){
+    unlinkCacheSlab(&c->full, slab);
+    pushCacheSlab(&c->partial, slab);
+  }
+  slab->used--;
+  if(slab->used == 0){
+    unlinkCacheSlab(&c->partial, slab);
+    pushCacheSlab(&c->empty, slab);
+  }
+  releaseLock(&c->lock, &waiter);
+}
+
+/*
+  __cache_reap_impl gives up the empty slabs of the cache handle: their objects are destructed and their pages given
+  back to the system, while their address range stays with the cache for later slabs. Returns the number of bytes
+  given back.
+*/
+size_t __cache_reap_impl(void *handle){
+  objectCache *c = handle;
+  cacheSlab *slabs, *slab, *next;
+  lockWaiter waiter;
+  size_t reaped = 0;
+  acquireLock(&c->lock, &waiter);
+  slabs = c->empty;
+  c->empty = NULL;
+  releaseLock(&c->lock, &waiter);
+  for(slab = slabs; slab != NULL; slab = next){
+    next = slab->next;
+    destructFree(c, slab);
+    madvise(slab, c->slabSize, MADV_DONTNEED);
+    reaped += c->slabSize;
+    acquireLock(&c->lock, &waiter);
+    slab->next = c->unused;
+    c->unused = slab;
+    releaseLock(&c->lock, &waiter);
+  }
+  return reaped;
+}
+
+/*
+  __cache_destroy_impl destructs the free objects of the cache handle and releases all of its memory. Objects that are
+  still allocated are released without being destructed.
+*/
+void __cache_destroy_impl(void *handle){
+  objectCache *c = handle;
+  cacheSlab *slab;
+  regionChunk *chunk, *prev;
+  if(c == NULL){
+    return;
+  }
+  pthread_mutex_lock(&cachesLock);
+  if(c->prev != NULL){
+    c->prev->next = c->next;
+  }
+  else{
+    caches = c->next;
+  }
+  if(c->next != NULL){
+    c->next->prev = c->prev;
+  }
+  pthread_mutex_unlock(&cachesLock);
+  for(slab = c->partial; slab != NULL; slab = slab->next){
+    destructFree(c, slab);
+  }
+  for(slab = c->empty; slab != NULL; slab = slab->next){
+    destructFree(c, slab);
+  }
+  //The cache lives in its first chunk, which is the last one released
+  for(chunk = c->chunks; chunk != NULL; chunk = prev){
+    prev = chunk->prev;
+    queueRelease(chunk, chunk->size);
+  }
+  wakeReclaimer();
+}
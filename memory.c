@@ -12,7 +12,7 @@
 
     gcc -fPIC -Wall -g -O0 -c memory.c 
     gcc -fPIC -Wall -g -O0 -c implementation.c
-    gcc -fPIC -shared -o memory.so memory.o implementation.o -lpthread
+    gcc -fPIC -shared -o memory.so memory.o implementation.o -lpthread -ldl
 
     To try the code out:
 
@@ -79,20 +79,56 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <pthread.h>
+#include <dlfcn.h>
+#include <unistd.h>
 
 
 void *__malloc_impl(size_t);
 void *__calloc_impl(size_t, size_t);
 void *__realloc_impl(void *, size_t);
 void __free_impl(void *);
+void __threads_started_impl(void);
+void __free_deferred_impl(void *);
+void *__heap_create_impl(void);
+void *__heap_malloc_impl(void *, size_t);
+void __heap_free_impl(void *, void *);
+void __heap_destroy_impl(void *);
+void *__region_create_impl(void);
+void *__region_alloc_impl(void *, size_t);
+void *__region_mark_impl(void *);
+void __region_release_impl(void *, void *);
+void __region_reset_impl(void *);
+void __region_destroy_impl(void *);
+size_t __malloc_batch_impl(size_t, size_t, void **);
+void __free_batch_impl(void **, size_t);
+void *__memalign_impl(size_t, size_t);
+size_t __malloc_usable_size_impl(void *);
+size_t __nallocx_impl(size_t, int);
+void __free_sized_impl(void *, size_t);
+void __free_aligned_sized_impl(void *, size_t, size_t);
+void *__mallocx_impl(size_t, int);
+void *__rallocx_impl(void *, size_t, int);
+void __dallocx_impl(void *, int);
+void *__malloc_site_impl(size_t, void *);
+void __alloc_tag_push_impl(int);
+void __alloc_tag_pop_impl(void);
+int __alloc_tag_stats_impl(int, size_t *, size_t *, size_t *, size_t *);
+int __alloc_tag_budget_impl(int, size_t, void (*)(int, size_t, size_t));
+void *__cache_create_impl(size_t, size_t, void (*)(void *), void (*)(void *));
+void *__cache_alloc_impl(void *);
+void __cache_free_impl(void *, void *);
+size_t __cache_reap_impl(void *);
+void __cache_destroy_impl(void *);
 
 static int __memory_print_debug_running = 0;
 static int __memory_print_debug_init_running = 0;
 static int __memory_print_debug_initialized = 0;
 static int __memory_print_debug_do_it = 0;
 
-static pthread_mutex_t memory_management_lock = PTHREAD_MUTEX_INITIALIZER;
+/* There is no global lock around the calls to the implementation:
+   the implementation locks the arena it works in by itself. */
 static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void __memory_print_debug_init() {
@@ -132,12 +168,12 @@ static void __memory_print_debug(const char *fmt, ...) {
   pthread_mutex_unlock(&print_lock);
 }
 
+/* The return address tells the implementation where the request was
+   made, see MEMORY_LIFETIME. */
 void *malloc(size_t size) {
   void *ptr;
 
-  pthread_mutex_lock(&memory_management_lock);
-  ptr = __malloc_impl(size);
-  pthread_mutex_unlock(&memory_management_lock);
+  ptr = __malloc_site_impl(size, __builtin_return_address(0));
   __memory_print_debug("malloc(0x%zx) = %p\n", size, ptr);
   return ptr;
 }
@@ -145,9 +181,7 @@ void *malloc(size_t size) {
 void *calloc(size_t nmemb, size_t size) {
   void *ptr;
 
-  pthread_mutex_lock(&memory_management_lock);
   ptr = __calloc_impl(nmemb, size);
-  pthread_mutex_unlock(&memory_management_lock);
   __memory_print_debug("calloc(0x%zx, 0x%zx) = %p\n", nmemb, size, ptr);
   return ptr;
 }
@@ -155,16 +189,568 @@ void *calloc(size_t nmemb, size_t size) {
 void *realloc(void *old_ptr, size_t size) {
   void *ptr;
 
-  pthread_mutex_lock(&memory_management_lock);
   ptr = __realloc_impl(old_ptr, size);
-  pthread_mutex_unlock(&memory_management_lock);
   __memory_print_debug("realloc(%p, 0x%zx) = %p\n", old_ptr, size, ptr);
   return ptr;
 }
 
 void free(void *ptr) {
-  pthread_mutex_lock(&memory_management_lock);
   __free_impl(ptr);
-  pthread_mutex_unlock(&memory_management_lock);
   __memory_print_debug("free(%p)\n", ptr);
 }
+
+/* The aligned family. posix_memalign reports errors through its
+   return value, the others return NULL and set errno. */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  void *ptr;
+
+  if ((alignment % sizeof(void *)) != 0 ||
+      (alignment & (alignment - 1)) != 0 ||
+      alignment == 0) {
+    return EINVAL;
+  }
+  ptr = __memalign_impl(alignment, size);
+  __memory_print_debug("posix_memalign(%p, 0x%zx, 0x%zx) = %p\n", memptr, alignment, size, ptr);
+  if ((ptr == NULL) && (size != 0)) {
+    return ENOMEM;
+  }
+  *memptr = ptr;
+  return 0;
+}
+
+void *memalign(size_t alignment, size_t size) {
+  void *ptr;
+
+  if ((alignment == 0) || ((alignment & (alignment - 1)) != 0)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  ptr = __memalign_impl(alignment, size);
+  __memory_print_debug("memalign(0x%zx, 0x%zx) = %p\n", alignment, size, ptr);
+  if ((ptr == NULL) && (size != 0)) {
+    errno = ENOMEM;
+  }
+  return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+void *valloc(size_t size) {
+  return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size) {
+  size_t page;
+
+  page = sysconf(_SC_PAGESIZE);
+  if (size > ((size_t) -1) - page) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+/* malloc_usable_size returns how many bytes the block at ptr can hold.
+   nallocx returns how many a block from mallocx(size, flags) would
+   hold, without allocating; see mallocx below for the flags. */
+size_t malloc_usable_size(void *ptr) {
+  size_t size;
+
+  size = __malloc_usable_size_impl(ptr);
+  __memory_print_debug("malloc_usable_size(%p) = 0x%zx\n", ptr, size);
+  return size;
+}
+
+size_t nallocx(size_t size, int flags) {
+  return __nallocx_impl(size, flags);
+}
+
+/* mallocx, rallocx and dallocx allocate, resize and free like malloc,
+   realloc and free, as asked for by flags, which are the bitwise or of
+   #define MALLOCX_LG_ALIGN(la) ((int) (la))
+   #define MALLOCX_ALIGN(a) ((int) (__builtin_ffsl(a) - 1))
+   #define MALLOCX_ZERO ((int) 0x40)
+   #define MALLOCX_TCACHE_NONE ((int) 0x100)
+   #define MALLOCX_SHORT_LIVED ((int) 0x10000)
+   #define MALLOCX_LONG_LIVED ((int) 0x20000)
+   #define MALLOCX_ARENA(a) ((int) (((unsigned) (a) + 1) << 20))
+   Short- and long-lived blocks each come from an arena of their own.
+   Blocks from mallocx can also be freed with free. Callers declare
+   void *mallocx(size_t size, int flags);
+   void *rallocx(void *ptr, size_t size, int flags);
+   void dallocx(void *ptr, int flags);
+   size_t nallocx(size_t size, int flags); */
+void *mallocx(size_t size, int flags) {
+  void *ptr;
+
+  ptr = __mallocx_impl(size, flags);
+  __memory_print_debug("mallocx(0x%zx, 0x%x) = %p\n", size, flags, ptr);
+  return ptr;
+}
+
+void *rallocx(void *old_ptr, size_t size, int flags) {
+  void *ptr;
+
+  ptr = __rallocx_impl(old_ptr, size, flags);
+  __memory_print_debug("rallocx(%p, 0x%zx, 0x%x) = %p\n", old_ptr, size, flags, ptr);
+  return ptr;
+}
+
+void dallocx(void *ptr, int flags) {
+  __dallocx_impl(ptr, flags);
+  __memory_print_debug("dallocx(%p, 0x%x)\n", ptr, flags);
+}
+
+/* free_sized and free_aligned_sized (C23) free ptr like free, given
+   the size, and for the latter the alignment, it was allocated with.
+   Passing any other size is undefined behavior. */
+void free_sized(void *ptr, size_t size) {
+  __free_sized_impl(ptr, size);
+  __memory_print_debug("free_sized(%p, 0x%zx)\n", ptr, size);
+}
+
+void free_aligned_sized(void *ptr, size_t alignment, size_t size) {
+  __free_aligned_sized_impl(ptr, alignment, size);
+  __memory_print_debug("free_aligned_sized(%p, 0x%zx, 0x%zx)\n", ptr, alignment, size);
+}
+
+/* free_deferred frees ptr like free but may leave the work to a
+   background thread, so that it returns without waiting for locks.
+   It is not part of the standard interface: callers declare it as
+   void free_deferred(void *ptr); */
+void free_deferred(void *ptr) {
+  __free_deferred_impl(ptr);
+  __memory_print_debug("free_deferred(%p)\n", ptr);
+}
+
+/* Private heaps: a heap returned by heap_create is used by one thread
+   at a time, without locking. Memory from heap_malloc goes back with
+   heap_free, never with free, and heap_destroy releases the heap
+   along with everything still allocated from it. None of these are
+   part of the standard interface; callers declare them as
+   void *heap_create(void);
+   void *heap_malloc(void *heap, size_t size);
+   void heap_free(void *heap, void *ptr);
+   void heap_destroy(void *heap); */
+void *heap_create(void) {
+  void *heap;
+
+  heap = __heap_create_impl();
+  __memory_print_debug("heap_create() = %p\n", heap);
+  return heap;
+}
+
+void *heap_malloc(void *heap, size_t size) {
+  void *ptr;
+
+  ptr = __heap_malloc_impl(heap, size);
+  __memory_print_debug("heap_malloc(%p, 0x%zx) = %p\n", heap, size, ptr);
+  return ptr;
+}
+
+void heap_free(void *heap, void *ptr) {
+  __heap_free_impl(heap, ptr);
+  __memory_print_debug("heap_free(%p, %p)\n", heap, ptr);
+}
+
+void heap_destroy(void *heap) {
+  __heap_destroy_impl(heap);
+  __memory_print_debug("heap_destroy(%p)\n", heap);
+}
+
+/* Batches: malloc_batch allocates count blocks of size bytes into out
+   and returns how many it allocated, which is less than count only
+   when memory ran out. free_batch frees the count blocks in ptrs and
+   leaves the contents of ptrs undefined. Callers declare
+   size_t malloc_batch(size_t size, size_t count, void **out);
+   void free_batch(void **ptrs, size_t count); */
+size_t malloc_batch(size_t size, size_t count, void **out) {
+  size_t got;
+
+  got = __malloc_batch_impl(size, count, out);
+  __memory_print_debug("malloc_batch(0x%zx, %zu, %p) = %zu\n", size, count, out, got);
+  return got;
+}
+
+void free_batch(void **ptrs, size_t count) {
+  __free_batch_impl(ptrs, count);
+  __memory_print_debug("free_batch(%p, %zu)\n", ptrs, count);
+}
+
+/* Regions: region_alloc bumps a pointer through the chunks of a
+   region, objects are never freed one by one. region_release frees
+   everything allocated since region_mark returned the mark,
+   region_reset frees everything and region_destroy the region
+   itself. A region is used by one thread at a time. Callers declare
+   void *region_create(void);
+   void *region_alloc(void *region, size_t size);
+   void *region_mark(void *region);
+   void region_release(void *region, void *mark);
+   void region_reset(void *region);
+   void region_destroy(void *region); */
+void *region_create(void) {
+  void *region;
+
+  region = __region_create_impl();
+  __memory_print_debug("region_create() = %p\n", region);
+  return region;
+}
+
+void *region_alloc(void *region, size_t size) {
+  void *ptr;
+
+  ptr = __region_alloc_impl(region, size);
+  __memory_print_debug("region_alloc(%p, 0x%zx) = %p\n", region, size, ptr);
+  return ptr;
+}
+
+void *region_mark(void *region) {
+  return __region_mark_impl(region);
+}
+
+void region_release(void *region, void *mark) {
+  __region_release_impl(region, mark);
+  __memory_print_debug("region_release(%p, %p)\n", region, mark);
+}
+
+void region_reset(void *region) {
+  __region_reset_impl(region);
+  __memory_print_debug("region_reset(%p)\n", region);
+}
+
+void region_destroy(void *region) {
+  __region_destroy_impl(region);
+  __memory_print_debug("region_destroy(%p)\n", region);
+}
+
+/* Allocation tags: between alloc_tag_push and the matching
+   alloc_tag_pop, everything the calling thread allocates is charged
+   to tag, a number from 1 to 63, until it is freed. alloc_tag_stats
+   reports the live bytes, the peak, and the bytes and number of
+   allocations charged to a tag so far; any of the pointers may be
+   NULL. alloc_tag_budget sets a soft budget in live bytes, 0 for
+   none, and a callback that is called, possibly from within malloc,
+   when the tag goes over it. Callers declare
+   void alloc_tag_push(int tag);
+   void alloc_tag_pop(void);
+   int alloc_tag_stats(int tag, size_t *live, size_t *peak,
+                       size_t *allocated, size_t *allocations);
+   int alloc_tag_budget(int tag, size_t budget,
+                        void (*callback)(int tag, size_t live, size_t budget)); */
+void alloc_tag_push(int tag) {
+  __alloc_tag_push_impl(tag);
+}
+
+void alloc_tag_pop(void) {
+  __alloc_tag_pop_impl();
+}
+
+int alloc_tag_stats(int tag, size_t *live, size_t *peak, size_t *allocated, size_t *allocations) {
+  return __alloc_tag_stats_impl(tag, live, peak, allocated, allocations);
+}
+
+int alloc_tag_budget(int tag, size_t budget, void (*callback)(int, size_t, size_t)) {
+  int res;
+
+  res = __alloc_tag_budget_impl(tag, budget, callback);
+  __memory_print_debug("alloc_tag_budget(%d, 0x%zx, %p) = %d\n", tag, budget, callback, res);
+  return res;
+}
+
+/* Object caches: cache_alloc returns an object of the size given to
+   cache_create on which ctor has run, and cache_free takes it back
+   as it is, without running dtor, so that the next cache_alloc can
+   hand it out again without constructing it. ctor only runs when the
+   cache sets up a new slab of objects, and dtor when cache_reap gives
+   up the slabs whose objects are all free, or on the free objects
+   when cache_destroy releases the cache. align is 0 for the default
+   of 16 or a power of two up to the page size. Callers declare
+   void *cache_create(size_t size, size_t align,
+                      void (*ctor)(void *), void (*dtor)(void *));
+   void *cache_alloc(void *cache);
+   void cache_free(void *cache, void *obj);
+   size_t cache_reap(void *cache);
+   void cache_destroy(void *cache); */
+void *cache_create(size_t size, size_t align, void (*ctor)(void *), void (*dtor)(void *)) {
+  void *cache;
+
+  cache = __cache_create_impl(size, align, ctor, dtor);
+  __memory_print_debug("cache_create(0x%zx, 0x%zx, %p, %p) = %p\n", size, align, ctor, dtor, cache);
+  return cache;
+}
+
+void *cache_alloc(void *cache) {
+  void *obj;
+
+  obj = __cache_alloc_impl(cache);
+  __memory_print_debug("cache_alloc(%p) = %p\n", cache, obj);
+  return obj;
+}
+
+void cache_free(void *cache, void *obj) {
+  __cache_free_impl(cache, obj);
+  __memory_print_debug("cache_free(%p, %p)\n", cache, obj);
+}
+
+size_t cache_reap(void *cache) {
+  size_t reaped;
+
+  reaped = __cache_reap_impl(cache);
+  __memory_print_debug("cache_reap(%p) = 0x%zx\n", cache, reaped);
+  return reaped;
+}
+
+void cache_destroy(void *cache) {
+  __cache_destroy_impl(cache);
+  __memory_print_debug("cache_destroy(%p)\n", cache);
+}
+
+/* pthread_create is wrapped so that the implementation knows when the
+   process stops being single-threaded: until then it does not need
+   to lock anything. It is told before the new thread exists. */
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+		   void *(*start_routine)(void *), void *arg) {
+  static int (*real_pthread_create)(pthread_t *, const pthread_attr_t *,
+				    void *(*)(void *), void *) = NULL;
+
+  __threads_started_impl();
+  if (real_pthread_create == NULL) {
+    real_pthread_create = dlsym(RTLD_NEXT, "pthread_create");
+    if (real_pthread_create == NULL) return EAGAIN;
+  }
+  return real_pthread_create(thread, attr, start_routine, arg);
+}
+
+/* The C++ operators new and delete, defined under their mangled names
+   (for LP64 targets, where size_t is unsigned long) so that C++
+   programs allocate from the implementation directly rather than
+   through libstdc++'s operators and malloc. Sized and aligned deletes
+   pass on what they know. Failure is reported the C++ way: the new
+   handler is called while there is one, then std::bad_alloc is thrown,
+   or NULL is returned by the nothrow forms. The two libstdc++
+   functions this needs are weak references, so processes without
+   libstdc++ do not need it loaded; a failing throwing new aborts in
+   them instead. */
+typedef void (*__memory_new_handler_t)(void);
+extern __memory_new_handler_t __memory_get_new_handler(void)
+  __asm__("_ZSt15get_new_handlerv") __attribute__((weak));
+extern void __memory_throw_bad_alloc(void)
+  __asm__("_ZSt17__throw_bad_allocv") __attribute__((weak, noreturn));
+
+/* Returns size bytes aligned to alignment (0 for the default), calling
+   the new handler until the allocation succeeds or there is no
+   handler. Returns NULL in the latter case. new must return distinct
+   pointers for size 0. site is the return address of the operator. */
+static void *__memory_new(size_t size, size_t alignment, void *site) {
+  void *ptr;
+  __memory_new_handler_t handler;
+
+  if (size == 0) size = 1;
+  while (1) {
+    if (alignment == 0) {
+      ptr = __malloc_site_impl(size, site);
+    } else {
+      ptr = __memalign_impl(alignment, size);
+    }
+    if (ptr != NULL) return ptr;
+    if (__memory_get_new_handler == NULL) return NULL;
+    handler = __memory_get_new_handler();
+    if (handler == NULL) return NULL;
+    handler();
+  }
+}
+
+static void *__memory_new_or_throw(size_t size, size_t alignment,
+				   void *site) {
+  void *ptr;
+
+  ptr = __memory_new(size, alignment, site);
+  if (ptr == NULL) {
+    if (__memory_throw_bad_alloc != NULL) __memory_throw_bad_alloc();
+    abort();
+  }
+  return ptr;
+}
+
+void *__memory_op_new(size_t size) __asm__("_Znwm");
+void *__memory_op_new_array(size_t size) __asm__("_Znam");
+void *__memory_op_new_nothrow(size_t size, const void *tag)
+  __asm__("_ZnwmRKSt9nothrow_t");
+void *__memory_op_new_array_nothrow(size_t size, const void *tag)
+  __asm__("_ZnamRKSt9nothrow_t");
+void *__memory_op_new_aligned(size_t size, size_t alignment)
+  __asm__("_ZnwmSt11align_val_t");
+void *__memory_op_new_array_aligned(size_t size, size_t alignment)
+  __asm__("_ZnamSt11align_val_t");
+void *__memory_op_new_aligned_nothrow(size_t size, size_t alignment,
+				      const void *tag)
+  __asm__("_ZnwmSt11align_val_tRKSt9nothrow_t");
+void *__memory_op_new_array_aligned_nothrow(size_t size, size_t alignment,
+					    const void *tag)
+  __asm__("_ZnamSt11align_val_tRKSt9nothrow_t");
+void __memory_op_delete(void *ptr) __asm__("_ZdlPv");
+void __memory_op_delete_array(void *ptr) __asm__("_ZdaPv");
+void __memory_op_delete_sized(void *ptr, size_t size) __asm__("_ZdlPvm");
+void __memory_op_delete_array_sized(void *ptr, size_t size)
+  __asm__("_ZdaPvm");
+void __memory_op_delete_nothrow(void *ptr, const void *tag)
+  __asm__("_ZdlPvRKSt9nothrow_t");
+void __memory_op_delete_array_nothrow(void *ptr, const void *tag)
+  __asm__("_ZdaPvRKSt9nothrow_t");
+void __memory_op_delete_aligned(void *ptr, size_t alignment)
+  __asm__("_ZdlPvSt11align_val_t");
+void __memory_op_delete_array_aligned(void *ptr, size_t alignment)
+  __asm__("_ZdaPvSt11align_val_t");
+void __memory_op_delete_sized_aligned(void *ptr, size_t size,
+				      size_t alignment)
+  __asm__("_ZdlPvmSt11align_val_t");
+void __memory_op_delete_array_sized_aligned(void *ptr, size_t size,
+					    size_t alignment)
+  __asm__("_ZdaPvmSt11align_val_t");
+void __memory_op_delete_aligned_nothrow(void *ptr, size_t alignment,
+					const void *tag)
+  __asm__("_ZdlPvSt11align_val_tRKSt9nothrow_t");
+void __memory_op_delete_array_aligned_nothrow(void *ptr, size_t alignment,
+					      const void *tag)
+  __asm__("_ZdaPvSt11align_val_tRKSt9nothrow_t");
+
+void *__memory_op_new(size_t size) {
+  void *ptr;
+
+  ptr = __memory_new_or_throw(size, 0, __builtin_return_address(0));
+  __memory_print_debug("operator new(0x%zx) = %p\n", size, ptr);
+  return ptr;
+}
+
+void *__memory_op_new_array(size_t size) {
+  void *ptr;
+
+  ptr = __memory_new_or_throw(size, 0, __builtin_return_address(0));
+  __memory_print_debug("operator new[](0x%zx) = %p\n", size, ptr);
+  return ptr;
+}
+
+void *__memory_op_new_nothrow(size_t size, const void *tag) {
+  void *ptr;
+
+  (void) tag;
+  ptr = __memory_new(size, 0, __builtin_return_address(0));
+  __memory_print_debug("operator new(0x%zx, nothrow) = %p\n", size, ptr);
+  return ptr;
+}
+
+void *__memory_op_new_array_nothrow(size_t size, const void *tag) {
+  void *ptr;
+
+  (void) tag;
+  ptr = __memory_new(size, 0, __builtin_return_address(0));
+  __memory_print_debug("operator new[](0x%zx, nothrow) = %p\n", size, ptr);
+  return ptr;
+}
+
+void *__memory_op_new_aligned(size_t size, size_t alignment) {
+  void *ptr;
+
+  ptr = __memory_new_or_throw(size, alignment, __builtin_return_address(0));
+  __memory_print_debug("operator new(0x%zx, 0x%zx) = %p\n", size, alignment, ptr);
+  return ptr;
+}
+
+void *__memory_op_new_array_aligned(size_t size, size_t alignment) {
+  void *ptr;
+
+  ptr = __memory_new_or_throw(size, alignment, __builtin_return_address(0));
+  __memory_print_debug("operator new[](0x%zx, 0x%zx) = %p\n", size, alignment, ptr);
+  return ptr;
+}
+
+void *__memory_op_new_aligned_nothrow(size_t size, size_t alignment,
+				      const void *tag) {
+  void *ptr;
+
+  (void) tag;
+  ptr = __memory_new(size, alignment, __builtin_return_address(0));
+  __memory_print_debug("operator new(0x%zx, 0x%zx, nothrow) = %p\n", size, alignment, ptr);
+  return ptr;
+}
+
+void *__memory_op_new_array_aligned_nothrow(size_t size, size_t alignment,
+					    const void *tag) {
+  void *ptr;
+
+  (void) tag;
+  ptr = __memory_new(size, alignment, __builtin_return_address(0));
+  __memory_print_debug("operator new[](0x%zx, 0x%zx, nothrow) = %p\n", size, alignment, ptr);
+  return ptr;
+}
+
+void __memory_op_delete(void *ptr) {
+  __free_impl(ptr);
+  __memory_print_debug("operator delete(%p)\n", ptr);
+}
+
+void __memory_op_delete_array(void *ptr) {
+  __free_impl(ptr);
+  __memory_print_debug("operator delete[](%p)\n", ptr);
+}
+
+/* Sizes of 0 were allocated as 1 byte, which is in the same class. */
+void __memory_op_delete_sized(void *ptr, size_t size) {
+  __free_sized_impl(ptr, size == 0 ? 1 : size);
+  __memory_print_debug("operator delete(%p, 0x%zx)\n", ptr, size);
+}
+
+void __memory_op_delete_array_sized(void *ptr, size_t size) {
+  __free_sized_impl(ptr, size == 0 ? 1 : size);
+  __memory_print_debug("operator delete[](%p, 0x%zx)\n", ptr, size);
+}
+
+void __memory_op_delete_nothrow(void *ptr, const void *tag) {
+  (void) tag;
+  __free_impl(ptr);
+  __memory_print_debug("operator delete(%p, nothrow)\n", ptr);
+}
+
+void __memory_op_delete_array_nothrow(void *ptr, const void *tag) {
+  (void) tag;
+  __free_impl(ptr);
+  __memory_print_debug("operator delete[](%p, nothrow)\n", ptr);
+}
+
+void __memory_op_delete_aligned(void *ptr, size_t alignment) {
+  __free_impl(ptr);
+  __memory_print_debug("operator delete(%p, 0x%zx)\n", ptr, alignment);
+}
+
+void __memory_op_delete_array_aligned(void *ptr, size_t alignment) {
+  __free_impl(ptr);
+  __memory_print_debug("operator delete[](%p, 0x%zx)\n", ptr, alignment);
+}
+
+void __memory_op_delete_sized_aligned(void *ptr, size_t size,
+				      size_t alignment) {
+  __free_aligned_sized_impl(ptr, alignment, size == 0 ? 1 : size);
+  __memory_print_debug("operator delete(%p, 0x%zx, 0x%zx)\n", ptr, size, alignment);
+}
+
+void __memory_op_delete_array_sized_aligned(void *ptr, size_t size,
+					    size_t alignment) {
+  __free_aligned_sized_impl(ptr, alignment, size == 0 ? 1 : size);
+  __memory_print_debug("operator delete[](%p, 0x%zx, 0x%zx)\n", ptr, size, alignment);
+}
+
+void __memory_op_delete_aligned_nothrow(void *ptr, size_t alignment,
+					const void *tag) {
+  (void) tag;
+  __free_impl(ptr);
+  __memory_print_debug("operator delete(%p, 0x%zx, nothrow)\n", ptr, alignment);
+}
+
+void __memory_op_delete_array_aligned_nothrow(void *ptr, size_t alignment,
+					      const void *tag) {
+  (void) tag;
+  __free_impl(ptr);
+  __memory_print_debug("operator delete[](%p, 0x%zx, nothrow)\n", ptr, alignment);
+}
@@ -0,0 +1,87 @@
+/*
+  freesized.c checks that free_sized and free_aligned_sized leave blocks that are not slab objects to free, even when
+  the size given is small enough for a slab. realloc keeps a block whose usable size is already the rounded size asked
+  for, so a block from memalign, which comes from the free list, can end up with a small size that free_sized is then
+  given. Were such a block put in a thread cache, the next malloc of that size would hand the free list block out as a
+  slab object. The program exits with 0 if every check passes and prints the first one that fails otherwise.
+
+  free_sized and free_aligned_sized are looked up at run time, as the C library may not have them. Build and run
+  against the shared library built from final.c and memory.c:
+    gcc -O2 -o freesized freesized.c -ldl
+    LD_PRELOAD=./memory.so ./freesized
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <dlfcn.h>
+
+#define ROUNDS 1000
+
+static void (*freeSized)(void *, size_t);
+static void (*freeAlignedSized)(void *, size_t, size_t);
+
+/*
+  keptBlock returns a block from memalign that realloc kept for its usable size, or NULL if realloc moved it. *size is
+  set to that size.
+*/
+static void *keptBlock(size_t *size){
+  void *block, *kept;
+  block = memalign(128, 1);
+  *size = malloc_usable_size(block);
+  kept = realloc(block, *size);
+  if(kept != block){
+    free(kept);
+    return NULL;
+  }
+  return kept;
+}
+
+/*
+  reused allocates size bytes ROUNDS times and returns 1 if any of them is block, 0 otherwise.
+*/
+static int reused(void *block, size_t size){
+  void *blocks[ROUNDS];
+  int i, found = 0;
+  for(i = 0; i < ROUNDS; i++){
+    blocks[i] = malloc(size);
+    found |= blocks[i] == block;
+  }
+  for(i = 0; i < ROUNDS; i++){
+    free(blocks[i]);
+  }
+  return found;
+}
+
+int main(){
+  void *block;
+  size_t size;
+  freeSized = (void (*)(void *, size_t)) dlsym(RTLD_DEFAULT, "free_sized");
+  freeAlignedSized = (void (*)(void *, size_t, size_t)) dlsym(RTLD_DEFAULT, "free_aligned_sized");
+  if(freeSized == NULL || freeAlignedSized == NULL){
+    printf("free_sized or free_aligned_sized is missing\n");
+    return 1;
+  }
+  block = keptBlock(&size);
+  if(block == NULL){
+    printf("realloc moved the block, nothing to check\n");
+    return 1;
+  }
+  freeSized(block, size);
+  if(reused(block, size)){
+    printf("free_sized: the free list block %p came back from malloc(%zu)\n", block, size);
+    return 1;
+  }
+  block = keptBlock(&size);
+  if(block == NULL){
+    printf("realloc moved the block, nothing to check\n");
+    return 1;
+  }
+  freeAlignedSized(block, 16, size);
+  if(reused(block, size)){
+    printf("free_aligned_sized: the free list block %p came back from malloc(%zu)\n", block, size);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}